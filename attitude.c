@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Fixed-point attitude integration from gyro rates
+ */
+
+#include "attitude.h"
+#include "gyrobias.h"
+
+
+#define ONE             ((long) 1 << ATTITUDE_FRAC_BITS)
+
+
+// =========== Static Variables ===============================================
+static long q[4];                       // w, x, y, z
+static long last_rate[3];               // [counts] GYROBIAS_FRAC_BITS
+static unsigned long last_ts;
+static unsigned int updates;
+static unsigned char norm_count;
+
+// =========== Function Stubs =================================================
+static long mulQ(long a, long b);
+static void normalise(void);
+
+// =========== Public Functions ===============================================
+
+void attitudeReset(void)
+{
+    q[0] = ONE;
+    q[1] = 0;
+    q[2] = 0;
+    q[3] = 0;
+
+    updates    = 0;
+    norm_count = 0;
+}
+
+void attitudeUpdate(int *gyro, int *bias, unsigned long ts)
+{
+    long rate[3], h[3], dq[4];
+    unsigned long dt = ts - last_ts;
+    unsigned char i;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        rate[i] = ((long) gyro[i] << GYROBIAS_FRAC_BITS) - bias[i];
+    }
+
+    // The first sample only sets where integration starts from
+    if ( updates > 0 )
+    {
+        // Half the rotation angle over dt, on each axis
+        for ( i = 0; i < 3; i++ )
+        {
+            h[i] = (long) (((long long) (last_rate[i] + rate[i]) * (long) dt
+                                * ATTITUDE_RATE_SCALE)
+                    >> (ATTITUDE_SCALE_SHIFT + GYROBIAS_FRAC_BITS + 1));
+        }
+
+        // q += q * (0, h)
+        dq[0] = - mulQ(q[1], h[0]) - mulQ(q[2], h[1]) - mulQ(q[3], h[2]);
+        dq[1] =   mulQ(q[0], h[0]) + mulQ(q[2], h[2]) - mulQ(q[3], h[1]);
+        dq[2] =   mulQ(q[0], h[1]) - mulQ(q[1], h[2]) + mulQ(q[3], h[0]);
+        dq[3] =   mulQ(q[0], h[2]) + mulQ(q[1], h[1]) - mulQ(q[2], h[0]);
+        for ( i = 0; i < 4; i++ ) q[i] += dq[i];
+
+        if ( ++norm_count >= ATTITUDE_NORM_PERIOD )
+        {
+            normalise();
+            norm_count = 0;
+        }
+    }
+
+    for ( i = 0; i < 3; i++ ) last_rate[i] = rate[i];
+    last_ts = ts;
+    if ( updates < 0xFFFF ) updates++;
+}
+
+void attitudeGetVector(int *xyz)
+{
+    unsigned char i;
+    long v;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        v = (q[i + 1] + ((long) 1 << (ATTITUDE_FRAC_BITS - 16)))
+                                            >> (ATTITUDE_FRAC_BITS - 15);
+        if ( q[0] < 0 ) v = -v;
+        xyz[i] = (v > 0x7FFF) ? 0x7FFF : ((v < -0x7FFF) ? -0x7FFF : v);
+    }
+}
+
+unsigned int attitudeGetUpdates(void)
+{
+    return updates;
+}
+
+
+// =========== Private Functions ==============================================
+
+static long mulQ(long a, long b)
+{
+    return (long) (((long long) a * b) >> ATTITUDE_FRAC_BITS);
+}
+
+static void normalise(void)
+{
+    long norm = 0;
+    unsigned char i;
+
+    // First order: q *= (3 - |q|^2) / 2, as |q| stays close to 1
+    for ( i = 0; i < 4; i++ ) norm += mulQ(q[i], q[i]);
+    for ( i = 0; i < 4; i++ ) q[i] = mulQ(q[i], ONE + ((ONE - norm) >> 1));
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Fixed-point attitude integration from gyro rates
+ */
+
+#ifndef __ATTITUDE_H
+#define __ATTITUDE_H
+
+
+#include "layout.h"
+
+#define ATTITUDE_FRAC_BITS      (30)
+#define ATTITUDE_SCALE_SHIFT    (16)    // of ATTITUDE_RATE_SCALE
+#define ATTITUDE_NORM_PERIOD    (16)    // [updates]
+
+
+void attitudeReset(void);
+
+// Feeds a raw gyro sample (x, y, z) read at time ts [us], with the bias as
+// kept by gyrobias.
+void attitudeUpdate(int *gyro, int *bias, unsigned long ts);
+
+// Vector part of the attitude, in Q15 and with w taken positive, so that w
+// follows from it: w = sqrt(1 - x^2 - y^2 - z^2).
+void attitudeGetVector(int *xyz);
+
+// Gyro updates since the last reset, saturating.
+unsigned int attitudeGetUpdates(void);
+
+
+#endif // __ATTITUDE_H
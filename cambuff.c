@@ -43,7 +43,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define CAMBUFF_BUFFER_SIZE     (30)
+// Rows are what lets sampling ride out flash writes, so they get whatever RAM
+// is left over (see py/ram_report.py): 16 KB less the 6000 B heap, ~3.2 KB of
+// other statics and ~1.7 KB for imageproc-lib and the stack
+#define CAMBUFF_BUFFER_SIZE     (34)
 
 // =========== Static Variables ===============================================
 static unsigned char is_ready = 0;
@@ -51,9 +54,17 @@ static unsigned char is_ready = 0;
 static CircArray full_rows, empty_rows;
 static CamRowStruct rows[CAMBUFF_BUFFER_SIZE];
 
+static unsigned char sched_mode = CAMBUFF_SCHED_ALL;
+static unsigned char sched_period, sched_phase, sched_last_row;
+static unsigned char sched_mask[CAMBUFF_ROW_MASK_SIZE];
+static unsigned char frame_rows;    // captured per frame, 0 until a frame ends
+
+static unsigned int overruns;   // full rows given up for new ones
+
 // =========== Function Stubs =================================================
 void cambuffIrqHandler(unsigned int irq_cause);
 
+static unsigned char isScheduledRow(unsigned char row_num);
 static void copyRows(CamRow dst, CamRow src);
 
 static void enqueueEmptyRow(CamRow row);
@@ -94,6 +105,61 @@ void cambuffReturnRow(CamRow row)
     enqueueEmptyRow(row);
 }
 
+unsigned int cambuffGetOverruns(void)
+{
+    return overruns;
+}
+
+void cambuffResetOverruns(void)
+{
+    overruns = 0;
+}
+
+void cambuffSetSchedule(unsigned char mode, unsigned char period,
+                        unsigned char phase, unsigned char *row_mask)
+{
+    if ( period == 0 ) period = 1;
+
+    sched_mode     = CAMBUFF_SCHED_ALL; // Keep the IRQ out while updating
+    sched_period   = period;
+    sched_phase    = phase % period;
+    sched_last_row = 0;
+
+    if ( row_mask != NULL )
+    {
+        memcpy(sched_mask, row_mask, CAMBUFF_ROW_MASK_SIZE);
+    } else {
+        memset(sched_mask, 0xFF, CAMBUFF_ROW_MASK_SIZE);
+    }
+
+    sched_mode     = mode;
+}
+
+unsigned char cambuffIsLastRow(unsigned char row_num)
+{
+    unsigned int next;
+
+    if ( frame_rows == 0 ) return 0;
+
+    switch ( sched_mode )
+    {
+        case CAMBUFF_SCHED_EVERY_KTH:
+        case CAMBUFF_SCHED_ROUND_ROBIN:
+            // Whatever the phase, scheduled rows are sched_period apart
+            return (unsigned int) row_num + sched_period >= frame_rows;
+
+        case CAMBUFF_SCHED_ROW_SET:
+            for ( next = row_num + 1; next < frame_rows; next++ )
+            {
+                if ( (sched_mask[next >> 3] >> (next & 0x7)) & 0x1 ) return 0;
+            }
+            return 1;
+
+        default:
+            return (unsigned int) row_num + 1 >= frame_rows;
+    }
+}
+
 // =========== Private Functions ==============================================
 void cambuffIrqHandler(unsigned int irq_cause)
 {
@@ -102,6 +168,9 @@ void cambuffIrqHandler(unsigned int irq_cause)
     data = camGetRow();
     if ( data == NULL ) return; // Should never happen
 
+    // Drop unwanted rows before they cost us a copy
+    if ( !isScheduledRow((unsigned char) data->row_num) ) return;
+
     copy = getEmptyRow();
     if ( copy == NULL ) return; // Should also never happen
 
@@ -109,6 +178,35 @@ void cambuffIrqHandler(unsigned int irq_cause)
     enqueueNewFullRow(copy);    // Add row to full queue
 }
 
+static unsigned char isScheduledRow(unsigned char row_num)
+{
+    unsigned char last_row = sched_last_row;
+
+    sched_last_row = row_num;
+    if ( row_num < last_row ) frame_rows = last_row + 1;
+
+    switch ( sched_mode )
+    {
+        case CAMBUFF_SCHED_EVERY_KTH:
+            return (row_num % sched_period) == sched_phase;
+
+        case CAMBUFF_SCHED_ROW_SET:
+            return (sched_mask[row_num >> 3] >> (row_num & 0x7)) & 0x1;
+
+        case CAMBUFF_SCHED_ROUND_ROBIN:
+            // Shift the phase on every new frame, so that all rows get
+            // revisited once every sched_period frames
+            if ( row_num < last_row )
+            {
+                if ( ++sched_phase >= sched_period ) sched_phase = 0;
+            }
+            return (row_num % sched_period) == sched_phase;
+
+        default:
+            return 1;
+    }
+}
+
 static void copyRows(CamRow dst, CamRow src)
 {
     if ( dst == NULL || src == NULL ) return;
@@ -127,6 +225,7 @@ static CamRow getEmptyRow(void)
     if ( carrayIsEmpty(empty_rows) )
     {
         row = getOldestFullRow();
+        if ( overruns < 0xFFFF ) overruns++;
     } else {
         row = carrayPopHead(empty_rows);
     }
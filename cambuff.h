@@ -40,6 +40,20 @@
 
 #include "cam.h"
 
+// Row schedules, applied in the capture IRQ so that unwanted rows never get
+// copied into the buffer:
+//  - ALL:         keep every row (default).
+//  - EVERY_KTH:   keep rows where (row_num % period) == phase.
+//  - ROW_SET:     keep rows whose bit is set in a row_num bitmask.
+//  - ROUND_ROBIN: like EVERY_KTH, but the phase advances on every new frame,
+//                 so the whole frame is covered once every period frames.
+#define CAMBUFF_SCHED_ALL           (0)
+#define CAMBUFF_SCHED_EVERY_KTH     (1)
+#define CAMBUFF_SCHED_ROW_SET       (2)
+#define CAMBUFF_SCHED_ROUND_ROBIN   (3)
+
+#define CAMBUFF_ROW_MASK_SIZE       (32) // [bytes] 1 bit per possible row_num
+
 void cambuffSetup(void);
 
 unsigned int cambuffHasNewRow(void);
@@ -48,5 +62,19 @@ CamRow cambuffGetRow(void);
 
 void cambuffReturnRow(CamRow row);
 
+// Rows lost because the buffer was full when a new one came in, as the
+// oldest one not yet taken is given up for it. Saturates.
+unsigned int cambuffGetOverruns(void);
+
+void cambuffResetOverruns(void);
+
+// row_mask is only used by CAMBUFF_SCHED_ROW_SET and may be NULL otherwise.
+void cambuffSetSchedule(unsigned char mode, unsigned char period,
+                        unsigned char phase, unsigned char *row_mask);
+
+// Is row_num the last row of a frame the schedule keeps? Always 0 until the
+// camera has gone through a whole frame, which gives its row count.
+unsigned char cambuffIsLastRow(unsigned char row_num);
+
 
 #endif
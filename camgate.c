@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Temporal change detection of camera rows
+ */
+
+#include "camgate.h"
+
+
+typedef struct {
+    unsigned char row_num;
+    unsigned char is_valid;
+    unsigned char block[CAMGATE_BLOCKS];
+} CacheSlotStruct;
+
+
+// =========== Static Variables ===============================================
+static CacheSlotStruct cache[CAMGATE_CACHE_SLOTS];
+static unsigned int threshold = 0;
+
+// =========== Public Functions ===============================================
+
+void camgateReset(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < CAMGATE_CACHE_SLOTS; i++ ) cache[i].is_valid = 0;
+}
+
+void camgateSetThreshold(unsigned int new_threshold)
+{
+    threshold = new_threshold;
+    camgateReset();
+}
+
+unsigned char camgateIsUnchanged(unsigned char row_num,
+                                 unsigned char *pixels)
+{
+    CacheSlotStruct *slot = &cache[row_num % CAMGATE_CACHE_SLOTS];
+    unsigned char block[CAMGATE_BLOCKS];
+    unsigned int  i, j, sum, sad = 0;
+
+    if ( threshold == 0 ) return 0;
+
+    for ( i = 0; i < CAMGATE_BLOCKS; i++ )
+    {
+        sum = 0;
+        for ( j = 0; j < CAMGATE_BLOCK_SIZE; j++ ) sum += *pixels++;
+        block[i] = sum / CAMGATE_BLOCK_SIZE; // a shift, for a power of 2
+
+        if ( block[i] > slot->block[i] )
+        {
+            sad += block[i] - slot->block[i];
+        } else {
+            sad += slot->block[i] - block[i];
+        }
+    }
+
+    if ( slot->is_valid && slot->row_num == row_num && sad < threshold )
+    {
+        return 1;
+    }
+
+    slot->row_num  = row_num;
+    slot->is_valid = 1;
+    for ( i = 0; i < CAMGATE_BLOCKS; i++ ) slot->block[i] = block[i];
+
+    return 0;
+}
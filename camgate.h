@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Temporal change detection of camera rows
+ */
+
+#ifndef __CAMGATE_H
+#define __CAMGATE_H
+
+
+#include "layout.h"
+
+// Rows are compared through their block means, cached by row_num. Each slot
+// takes CAMGATE_BLOCKS + 2 bytes of RAM, 21 * 32 = 672 bytes in all, and
+// schedules of more rows than slots have rows evicting each other.
+#define CAMGATE_BLOCK_SIZE      (8)     // [pixels] averaged per block
+#define CAMGATE_BLOCKS          (ROW_SIZE / CAMGATE_BLOCK_SIZE)
+#define CAMGATE_CACHE_SLOTS     (32)
+
+
+// Forgets every cached row.
+void camgateReset(void);
+
+// Rows are unchanged if the sum of absolute differences of their block
+// means is below threshold. A threshold of 0 lets every row through.
+void camgateSetThreshold(unsigned int threshold);
+
+// Returns 1 if the row is unchanged. Otherwise, it becomes the reference
+// for its row_num and 0 is returned.
+unsigned char camgateIsUnchanged(unsigned char row_num,
+                                 unsigned char *pixels);
+
+
+#endif // __CAMGATE_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * On-flash run catalog
+ */
+
+#include "catalog.h"
+#include "dfmem.h"
+#include "crc.h"
+
+#include <string.h>
+
+#define CATALOG_BUFFER      (1) // DataFlash SRAM buffer used for writes
+#define CATALOG_CRC_LENGTH  (sizeof(CatalogRecord) - sizeof(unsigned int))
+
+
+// =========== Static Variables ===============================================
+static CatalogRecord catalog;
+
+// =========== Function Stubs =================================================
+static void writeCatalog(void);
+
+// =========== Public Functions ===============================================
+
+void catalogSetup(void)
+{
+    dfmemRead(CATALOG_PAGE, 0, sizeof(catalog), catalog.contents);
+
+    // An erased or corrupted page holds no runs
+    if ( catalog.runs > CATALOG_MAX_RUNS ||
+         catalog.crc != crcUpdate(CRC_INIT, catalog.contents,
+                                            CATALOG_CRC_LENGTH) )
+    {
+        catalog.runs = 0;
+    }
+}
+
+unsigned int catalogGetRuns(void)
+{
+    return catalog.runs;
+}
+
+RunEntryRecord* catalogGetRun(unsigned int index)
+{
+    if ( index >= catalog.runs ) return NULL;
+
+    return &catalog.run[index];
+}
+
+unsigned int catalogNextPage(unsigned int base)
+{
+    RunEntryRecord *last;
+    unsigned long next = base;
+
+    if ( catalog.runs != 0 )
+    {
+        last = &catalog.run[catalog.runs - 1];
+        if ( (unsigned long) last->start_page + last->pages > next )
+            next = (unsigned long) last->start_page + last->pages;
+    }
+
+    next += MEM_SECTOR_SIZE - 1;
+    next -= next % MEM_SECTOR_SIZE;
+
+    return (unsigned int) next;
+}
+
+unsigned char catalogHasRoom(unsigned int base, unsigned int pages)
+{
+    return catalog.runs < CATALOG_MAX_RUNS &&
+        (unsigned long) catalogNextPage(base) + pages <= MEM_PAGE_COUNT;
+}
+
+void catalogAppend(RunEntryRecord* entry)
+{
+    if ( catalog.runs >= CATALOG_MAX_RUNS ) return;
+
+    memcpy ( catalog.run[catalog.runs++].contents, entry->contents,
+                                                    sizeof(RunEntryRecord) );
+    writeCatalog();
+}
+
+void catalogClear(void)
+{
+    catalog.runs = 0;
+    writeCatalog();
+}
+
+// =========== Private Functions ==============================================
+
+static void writeCatalog(void)
+{
+    catalog.crc = crcUpdate(CRC_INIT, catalog.contents, CATALOG_CRC_LENGTH);
+
+    // Programs the page through a buffer, erasing it first
+    dfmemWrite(catalog.contents, sizeof(catalog), CATALOG_PAGE, 0,
+                                                            CATALOG_BUFFER);
+}
@@ -41,7 +41,17 @@
  */
 
 #include "cmd.h"
+#include "layout.h"
 #include "motor_ctrl.h"
+#include "speedctrl.h"
+#include "flowsteer.h"
+#include "sampleskip.h"
+#include "pixpack.h"
+#include "attitude.h"
+#include "runstats.h"
+#include "rowcorr.h"
+#include "sequence.h"
+#include "profile.h"
 #include "led.h"
 #include "sclock.h"
 
@@ -51,66 +61,63 @@
 #include "radio_settings.h"
 
 #include "dfmem.h"
+#include "catalog.h"
 #include "cam.h"
 #include "cambuff.h"
+#include "camgate.h"
 #include "gyro.h"
+#include "gyrobias.h"
+#include "crc.h"
 
 #include <string.h>
 
 
-/* Commands */
-#define CMD_MAX 0xFF
-
-// TODO (fgb) : Should these be part of py-generated h file?
-#define CMD_RESET                 2
-#define CMD_ERASE_MEMORY          3
-#define CMD_RECORD_SENSOR_DUMP    4
-#define CMD_READ_MEMORY           5
-#define CMD_GET_SETTINGS          6
-#define CMD_SET_SAMPLING_PERIOD   7
-#define CMD_SET_MEMORY_PAGE_START 8
-#define CMD_SET_MOTOR_SPEED       9
-#define CMD_CALIBRATE_GYRO        10
-
 /* Default Settings */
 #define DEFAULT_SAMPLING_PERIOD  1000 // [us]
-#define DEFAULT_MEM_PAGE_START   128
+#define DEFAULT_MEM_PAGE_START   (CATALOG_PAGE + MEM_SECTOR_SIZE)
 #define DEFAULT_MOTOR_DUTY_CYCLE 0
 
-#define DEFAULT_ROW_SIZE         152  // [bytes]
-#define DEFAULT_MEM_PAGE_SIZE    528  // [bytes]
-#define DEFAULT_MEM_SECTOR_SIZE  128  // [pages]
+#define GYRO_BIAS_PERIOD         1000 // [us] between samples when idle
+
+#define ROW_CALIB_TIMEOUT     2000000 // [us] to take the calibration rows
+#define ROW_CORR_BENCH_ROWS        32 // corrected to time each pass
 
 
 /*-----------------------------------------------------------------------------
  *          Private declarations
  *---------------------------------------------------------------------------*/
 
-void (*cmd_func[CMD_MAX]) (unsigned char, unsigned char, unsigned char*);
-
-union {
-    struct {
-        unsigned int  id;                   // (2)   sample number
-        unsigned long bemf_ts;              // (4)
-        unsigned int  bemf;                 // (2)   main motor Back-EMF
-        unsigned long gyro_ts;              // (4)
-        unsigned char gyro[3*sizeof(int)];  // (6)   raw gyro values
-        unsigned long row_ts;               // (4)
-        unsigned char row_num;              // (1)   physical row number
-        unsigned char row_valid;            // (1)   was row captured?
-        unsigned char row[DEFAULT_ROW_SIZE];// (152) camera image row
-    };
-    unsigned char contents[176];
-} sample;
-
-union {
-    struct {
-        unsigned int sampling_period;
-        unsigned int mem_page_start;
-        float        motor_duty_cycle;
-    };
-    unsigned char contents[2 * sizeof(unsigned int) + sizeof(float)];
-} settings;
+typedef void (*CmdHandler) (unsigned char, unsigned char, unsigned char*);
+
+SampleRecord   sample;
+SettingsRecord settings;
+
+static unsigned int motor_pdc; // settings.motor_duty_cycle, precomputed
+
+static unsigned long next_gyro_bias_time = 0;
+
+static unsigned int read_page_start; // of the run last read, for READ_PAGES
+
+static ReadStatsRecord read_stats;   // of the pages sent since the last read
+static ReadSliceRecord read_slices[READ_SLICES]; // its timeline
+static unsigned int read_tx_taken;   // packets the radio took since then
+static unsigned int read_first_page, read_pages; // which the slices cover
+
+static SteerStatsRecord steer_stats; // of the last run steered on flow
+
+static SetRowScheduleArgs row_schedule; // as last set, for run headers
+
+static unsigned long seq_timestamp;  // [s] host clock when the sequence ran
+static unsigned long seq_start_time; // [us] sclock at the same time
+
+// Samples are stored back to back, straddling page boundaries if need be,
+// and every page closes with the CRC of its data
+static struct {
+    unsigned int  page;
+    unsigned int  byte;
+    unsigned int  crc;
+    unsigned char buffer;
+} store = { 0, 0, CRC_INIT, 1 };
 
 
 /*----------------------------------------------------------------------------
@@ -129,6 +136,9 @@ static void   cmdRecordSensorDump (unsigned char status,
 static void         cmdReadMemory (unsigned char status,
                                    unsigned char length,
                                    unsigned char *frame);
+static void          cmdReadPages (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
 static void        cmdGetSettings (unsigned char status,
                                    unsigned char length,
                                    unsigned char *frame);
@@ -144,54 +154,246 @@ static void      cmdSetMotorSpeed (unsigned char status,
 static void      cmdCalibrateGyro (unsigned char status,
                                    unsigned char length,
                                    unsigned char *frame);
+static void    cmdSetRowSchedule (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void       cmdSetSpeedCtrl (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void         cmdSetProfile (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void           cmdListRuns (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void            cmdReadRun (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void       cmdClearCatalog (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void           cmdTimeSync (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void         cmdSetRowGate (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void       cmdGetReadStats (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void       cmdSetSteerCtrl (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void      cmdGetSteerStats (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void      cmdSetSampleSkip (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void      cmdSetPixelDepth (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void        cmdSetAttitude (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void      cmdGetRunSummary (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void      cmdCalibrateRows (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void         cmdSetRowCorr (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void         cmdGetRowCorr (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void        cmdSetSequence (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+static void        cmdRunSequence (unsigned char status,
+                                   unsigned char length,
+                                   unsigned char *frame);
+
+static void               cmdDispatch (unsigned char command,
+                                        unsigned char status,
+                                        unsigned char length,
+                                        unsigned char *frame);
+static void  cmdSendSequenceProgress (void);
+static void             cmdSendPages (unsigned char type,
+                                      unsigned int page,
+                                      unsigned int count,
+                                      unsigned int pld_size);
+static void        cmdProcessReadTx (ReadSliceRecord *slice);
+static unsigned int    cmdSampleSize (void);
+static unsigned int    cmdCountPages (unsigned long samples);
+static void            cmdStoreStart (unsigned int page);
+static void                 cmdStore (unsigned char *data,
+                                      unsigned int length);
+static void            cmdStoreFlush (void);
+static unsigned long    cmdStoreRoom (void);
+static void        cmdUpdateGyroBias (void);
+static void             cmdSteerStep (unsigned long frame_ts,
+                                      unsigned long detect_ts);
 
 
 /*-----------------------------------------------------------------------------
- *          Public functions
+ *          Command table
  *---------------------------------------------------------------------------*/
 
-void cmdSetup (void)
-{
-    unsigned int i;
+// Kept const, so that it stays in program memory, and only lists the IDs in
+// use (see layout.h, generated by py/layout.py)
+static const struct {
+    unsigned char id;
+    CmdHandler    handler;
+} cmd_table[] = {
+    { CMD_RESET,                 &cmdReset              },
+    { CMD_ERASE_MEMORY,          &cmdEraseMemory        },
+    { CMD_RECORD_SENSOR_DUMP,    &cmdRecordSensorDump   },
+    { CMD_READ_MEMORY,           &cmdReadMemory         },
+    { CMD_GET_SETTINGS,          &cmdGetSettings        },
+    { CMD_SET_SAMPLING_PERIOD,   &cmdSetSamplingPeriod  },
+    { CMD_SET_MEMORY_PAGE_START, &cmdSetMemoryPageStart },
+    { CMD_SET_MOTOR_SPEED,       &cmdSetMotorSpeed      },
+    { CMD_CALIBRATE_GYRO,        &cmdCalibrateGyro      },
+    { CMD_SET_ROW_SCHEDULE,      &cmdSetRowSchedule     },
+    { CMD_SET_SPEED_CTRL,        &cmdSetSpeedCtrl       },
+    { CMD_SET_PROFILE,           &cmdSetProfile         },
+    { CMD_READ_PAGES,            &cmdReadPages          },
+    { CMD_LIST_RUNS,             &cmdListRuns           },
+    { CMD_READ_RUN,              &cmdReadRun            },
+    { CMD_CLEAR_CATALOG,         &cmdClearCatalog       },
+    { CMD_TIME_SYNC,             &cmdTimeSync           },
+    { CMD_SET_ROW_GATE,          &cmdSetRowGate         },
+    { CMD_GET_READ_STATS,        &cmdGetReadStats       },
+    { CMD_SET_STEER_CTRL,        &cmdSetSteerCtrl       },
+    { CMD_GET_STEER_STATS,       &cmdGetSteerStats      },
+    { CMD_SET_SAMPLE_SKIP,       &cmdSetSampleSkip      },
+    { CMD_SET_PIXEL_DEPTH,       &cmdSetPixelDepth      },
+    { CMD_SET_ATTITUDE,          &cmdSetAttitude        },
+    { CMD_GET_RUN_SUMMARY,       &cmdGetRunSummary      },
+    { CMD_CALIBRATE_ROWS,        &cmdCalibrateRows      },
+    { CMD_SET_ROW_CORR,          &cmdSetRowCorr         },
+    { CMD_GET_ROW_CORR,          &cmdGetRowCorr         },
+    { CMD_SET_SEQUENCE,          &cmdSetSequence        },
+    { CMD_RUN_SEQUENCE,          &cmdRunSequence        },
+};
+
+#define CMD_TABLE_SIZE  (sizeof(cmd_table) / sizeof(cmd_table[0]))
 
-    for ( i = 0; i < CMD_MAX; ++i ) cmd_func[i] = NULL;
 
-    cmd_func[CMD_RESET]                 = &cmdReset;
-    cmd_func[CMD_ERASE_MEMORY]          = &cmdEraseMemory;
-    cmd_func[CMD_RECORD_SENSOR_DUMP]    = &cmdRecordSensorDump;
-    cmd_func[CMD_READ_MEMORY]           = &cmdReadMemory;
-    cmd_func[CMD_GET_SETTINGS]          = &cmdGetSettings;
-    cmd_func[CMD_SET_SAMPLING_PERIOD]   = &cmdSetSamplingPeriod;
-    cmd_func[CMD_SET_MEMORY_PAGE_START] = &cmdSetMemoryPageStart;
-    cmd_func[CMD_SET_MOTOR_SPEED]       = &cmdSetMotorSpeed;
-    cmd_func[CMD_CALIBRATE_GYRO]        = &cmdCalibrateGyro;
-}
+/*-----------------------------------------------------------------------------
+ *          Public functions
+ *---------------------------------------------------------------------------*/
 
 void cmdResetSettings (void)
 {
     settings.sampling_period  = DEFAULT_SAMPLING_PERIOD;
     settings.mem_page_start   = DEFAULT_MEM_PAGE_START;
     settings.motor_duty_cycle = DEFAULT_MOTOR_DUTY_CYCLE;
+    settings.speed_setpoint   = 0;
+    settings.speed_kp         = 0;
+    settings.speed_ki         = 0;
+    settings.speed_ctrl       = 0;
+    settings.row_gate         = 0;
+    settings.steer_ctrl       = 0;
+    settings.steer_kp         = 0;
+    settings.steer_kd         = 0;
+    settings.steer_derot      = 0;
+    settings.sample_skip_max  = 1;
+    settings.skip_gyro_full   = 0;
+    settings.skip_bemf_full   = 0;
+    settings.pixel_depth      = 8;
+    settings.pixel_compand    = PIXEL_LINEAR;
+    settings.pixel_dither     = 0;
+    settings.attitude_period  = 0;
+    settings.attitude_log     = ATTITUDE_OFF;
+    settings.pad              = 0;
+
+    cmdUpdateGyroBias();
+    camgateSetThreshold(settings.row_gate);
+    flowsteerSetGains(settings.steer_kp, settings.steer_kd);
+    flowsteerSetDerotation(settings.steer_derot);
+    sampleskipSetup(settings.sample_skip_max, settings.skip_gyro_full,
+                                              settings.skip_bemf_full);
+    pixpackSetup(settings.pixel_depth, settings.pixel_compand,
+                                       settings.pixel_dither);
+
+    motor_pdc = mcDutyCycleToPdc(settings.motor_duty_cycle);
+    speedctrlSetSetpoint(settings.speed_setpoint);
+    speedctrlSetGains(settings.speed_kp, settings.speed_ki);
+
+    row_schedule.mode   = CAMBUFF_SCHED_ALL;
+    row_schedule.period = 1;
+    row_schedule.phase  = 0;
+    memset ( row_schedule.row_mask, 0, sizeof(row_schedule.row_mask) );
+    cambuffSetSchedule(row_schedule.mode, row_schedule.period,
+                       row_schedule.phase, NULL);
 }
 
 void cmdHandleRadioRxBuffer (void)
 {
     MacPacket packet;
     Payload pld;
-    unsigned char command, status;
 
     if ( (packet = radioDequeueRxPacket()) != NULL )
     {
-        pld     = macGetPayload(packet);
-        status  = payGetStatus(pld);
-        command = payGetType(pld);
+        pld = macGetPayload(packet);
+        cmdDispatch(payGetType(pld), payGetStatus(pld),
+                                payGetDataLength(pld), payGetData(pld));
+        radioReturnPacket(packet);
+    }
+}
 
-        if ( command < CMD_MAX )
+void cmdProcessSequence (void)
+{
+    SequenceStepRecord *step;
+    RecordSensorDumpArgs record;
+    unsigned char frame[SEQ_ARGS_SIZE];
+
+    if ( sequenceGetProgress()->state != SEQ_RUNNING ) return;
+
+    // Steps run one per call, letting the radio through between them, and
+    // only their start and the end of the sequence are reported
+    if ( (step = sequenceNext(sclockGetTime())) == NULL )
+    {
+        if ( sequenceGetProgress()->state != SEQ_RUNNING )
         {
-            cmd_func[command](status, payGetDataLength(pld), payGetData(pld));
+            cmdSendSequenceProgress();
         }
+        return;
+    }
 
-        radioReturnPacket(packet);
+    cmdSendSequenceProgress();
+    radioProcess();
+
+    memcpy ( frame, step->args, SEQ_ARGS_SIZE );
+
+    // Runs are cataloged by host time, as if each had been asked for then
+    if ( step->cmd == CMD_RECORD_SENSOR_DUMP &&
+                                LAYOUT_UNPACK(record, frame, step->length) )
+    {
+        record.timestamp = seq_timestamp +
+                            (sclockGetTime() - seq_start_time) / 1000000;
+        memcpy ( frame, record.contents, sizeof(record) );
+    }
+
+    cmdDispatch(step->cmd, sequenceGetProgress()->step, step->length, frame);
+}
+
+void cmdTrackGyroBias (void)
+{
+    int xyz[3];
+
+    // Keeps the bias estimate current between runs, which is what allows
+    // the host to skip the blocking calibration
+    if ( sclockGetTime() > next_gyro_bias_time )
+    {
+        gyroGetXYZ((unsigned char *) xyz);
+        gyrobiasUpdate(xyz);
+        cmdUpdateGyroBias();
+
+        next_gyro_bias_time = sclockGetTime() + GYRO_BIAS_PERIOD;
     }
 }
 
@@ -211,16 +413,25 @@ static void cmdEraseMemory (unsigned char status,
                             unsigned char length,
                             unsigned char *frame)
 {
-    unsigned int  samples       = frame[0] + (frame[1] << 8),
-                  mem_page      = settings.mem_page_start,
-                  mem_page_last = settings.mem_page_start + samples/3;
+    EraseMemoryArgs args;
+    unsigned int    mem_page;
+    unsigned long   mem_page_last;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+    if ( !catalogHasRoom(settings.mem_page_start, 1) ) return;
+
+    // Erase the next free extent, leaving the runs in the catalog intact,
+    // up to the end of the flash if the run may not fit
+    mem_page      = catalogNextPage(settings.mem_page_start);
+    mem_page_last = (unsigned long) mem_page + cmdCountPages(args.samples);
+    if ( mem_page_last > MEM_PAGE_COUNT ) mem_page_last = MEM_PAGE_COUNT;
 
     LED_GREEN = 0; LED_RED = 1; LED_ORANGE = 0;
 
     do
     {
         dfmemEraseSector(mem_page);
-        mem_page += DEFAULT_MEM_SECTOR_SIZE;
+        mem_page += MEM_SECTOR_SIZE;
     } while ( mem_page < mem_page_last );
 
     LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
@@ -230,74 +441,257 @@ static void cmdRecordSensorDump (unsigned char status,
                                  unsigned char length,
                                  unsigned char *frame)
 {
-    unsigned int  samples          = frame[0] + (frame[1] << 8),
-                  sample_motor_on  = frame[2] + (frame[3] << 8),
-                  sample_motor_off = frame[4] + (frame[5] << 8),
-                  count            = 0,
-                  mem_byte         = 0,
-                  mem_page         = settings.mem_page_start;
+    RecordSensorDumpArgs args;
+    RunHeaderRecord      header;
+    RunEntryRecord       entry;
+    unsigned long count            = 0;
+    unsigned long slot             = 0; // of the next sample, at full rate
     unsigned long next_sample_time = sclockGetTime();
-    static unsigned char buffer    = 1;
+    unsigned long frame_ts         = 0; // capture of the latest row steered on
+    unsigned long next_gyro_time   = 0; // read between samples for attitude
+    unsigned long late;                 // [us] the sample was taken after due
+    unsigned char skip             = 1; // periods until the next sample
+    unsigned char is_last;              // row closes a frame for flowsteer
+    AttitudeRecord attitude;            // logged after the sample, if asked
+    int gyro[3];
+    int rates[3] = { 0, 0, 0 };         // raw, of the last sample
     CamRow row_buff;
 
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    entry.timestamp      = args.timestamp;
+    entry.start_page     = catalogNextPage(settings.mem_page_start);
+    entry.rows_stored    = 0;
+    entry.rows_unchanged = 0;
+
+    // Refuse to record if the catalog or the flash is full. Otherwise, the
+    // run ends early if the flash fills up before all samples are taken
+    if ( !catalogHasRoom(settings.mem_page_start, 1) )
+    {
+        LED_GREEN = 0; LED_RED = 1; LED_ORANGE = 0;
+        delay_ms(2000);
+        LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
+        return;
+    }
+
     LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 1;
 
+    cmdStoreStart(entry.start_page);
+
+    // The run opens with a header stamping the bias it was recorded with
+    cmdUpdateGyroBias();
+    header.start_time      = next_sample_time;
+    header.samples         = args.samples; // requested, see entry.samples
+    header.sample_size     = sizeof(sample);
+    header.row_size        = pixpackRowSize();
+    header.sampling_period = settings.sampling_period;
+    memcpy ( header.gyro_bias, settings.gyro_bias, sizeof(header.gyro_bias) );
+    header.gyro_bias_conf  = settings.gyro_bias_conf;
+    header.gyro_bias_age   = settings.gyro_bias_age;
+    header.sample_skip_max = settings.sample_skip_max;
+    header.pixel_depth     = settings.pixel_depth;
+    header.pixel_compand   = settings.pixel_compand;
+    header.pixel_dither    = settings.pixel_dither;
+    header.attitude_period = settings.attitude_period;
+    header.row_corr        = rowcorrIsEnabled();
+    header.attitude_log    = settings.attitude_log;
+    // Lets the host tell which rows closed a frame, see cambuffIsLastRow
+    header.row_sched_mode   = row_schedule.mode;
+    header.row_sched_period = row_schedule.period;
+    header.row_sched_phase  = row_schedule.phase;
+    header.row_sched_pad    = 0;
+    memcpy ( header.row_sched_mask, row_schedule.row_mask,
+                                    sizeof(header.row_sched_mask) );
+    memcpy ( header.settings.contents, settings.contents, sizeof(settings) );
+    cmdStore(header.contents, sizeof(header));
+
+    // Rows only count as unchanged against those stored in this run
+    camgateReset();
+
+    // Steering starts from scratch, as the previous frame is long gone
+    memset ( steer_stats.contents, 0, sizeof(steer_stats) );
+    if ( settings.steer_ctrl )
+    {
+        mcSetSteerMode(MC_STEER_MODE_CONT);
+        flowsteerReset();
+    }
+    sample.steer_pdc = 0;
+
+    sampleskipReset();
+
+    attitudeReset();
+
+    runstatsReset(args.samples, settings.sampling_period);
+    cambuffResetOverruns();
+
     camStart(); // Enable camera capture interrupt
 
+    // An uploaded profile takes over from the motor on/off samples, and
+    // from steering too unless it follows the flow. Its last point is held
+    // up to the motor off sample.
+    profileStart(settings.speed_ctrl, !settings.steer_ctrl);
+
     do
     {
         if ( sclockGetTime() > next_sample_time )
         {
+            late = sclockGetTime() - next_sample_time;
+
             // Capture sensor sample
             if ( cambuffHasNewRow() )                       // Camera
             {
                 row_buff         = cambuffGetRow();
+                if ( rowcorrIsEnabled() ) rowcorrApply(row_buff->pixels);
                 sample.row_ts    = row_buff->timestamp;
                 sample.row_num   = (unsigned char) row_buff->row_num;
-                sample.row_valid = 1;
-                memcpy ( sample.row, row_buff->pixels, DEFAULT_ROW_SIZE );
-                cambuffReturnRow(row_buff);
+                if ( camgateIsUnchanged(sample.row_num, row_buff->pixels) )
+                {
+                    sample.row_valid = ROW_UNCHANGED;
+                    entry.rows_unchanged++;
+                } else {
+                    sample.row_valid = ROW_STORED;
+                    entry.rows_stored++;
+                }
+
+                // Steer as soon as a row completes a frame, i.e. before
+                // anything else gets to delay it
+                sample.steer_latency = 0;
+                if ( settings.steer_ctrl )
+                {
+                    is_last = cambuffIsLastRow(sample.row_num);
+                    if ( is_last ) frame_ts = sample.row_ts;
+                    if ( flowsteerAddRow(sample.row_num, row_buff->pixels,
+                                                                is_last) )
+                    {
+                        cmdSteerStep(frame_ts, sclockGetTime());
+                    }
+                    frame_ts = sample.row_ts;
+                }
+
+                runstatsAddRow(row_buff->pixels, slot);
             } else {
+                row_buff         = NULL;
                 sample.row_ts    = 0;
                 sample.row_num   = 0;
-                sample.row_valid = 0;
-                memset ( sample.row, 0, DEFAULT_ROW_SIZE );
+                sample.row_valid = ROW_NONE;
+                sample.steer_latency = 0;
             }
 
             sample.gyro_ts = sclockGetTime();               // Gyroscope
-            gyroGetXYZ(sample.gyro);
+            gyroGetXYZ((unsigned char *) sample.gyro);
+            memcpy ( rates, sample.gyro, sizeof(rates) );
+            gyrobiasUpdate(sample.gyro);
+            if ( settings.steer_ctrl )
+            {
+                flowsteerAddRotation(sample.gyro[2] -
+                            (gyrobiasGet()[2] >> GYROBIAS_FRAC_BITS), skip);
+            }
+            if ( settings.attitude_period )
+            {
+                attitudeUpdate(sample.gyro, gyrobiasGet(), sample.gyro_ts);
+                next_gyro_time = sample.gyro_ts + settings.attitude_period;
+            }
+
+            sample.bemf_ts   = sclockGetTime();             // Back-EMF
+            sample.bemf      = ADC1BUF0;
+            sample.motor_pdc = PDC1;                        // Motor
+            sample.motor_err = speedctrlGetError();
 
-            sample.bemf_ts = sclockGetTime();               // Back-EMF
-            sample.bemf    = ADC1BUF0;
+            sample.id      = (unsigned int) count++;        // Sample #
 
-            sample.id      = count++;                       // Sample #
+            runstatsAddSample(&sample, late);
 
-            // Send sample to memory buffer
-            dfmemWriteBuffer(sample.contents, sizeof(sample), mem_byte, buffer);
-            mem_byte += sizeof(sample);
+            // Send sample to memory, with the attitude in place of its gyro
+            // rates or after it as the run asks, followed by its row's
+            // pixels unless they are left out, packed in place in the row
+            // buffer
+            if ( settings.attitude_log == ATTITUDE_IN_GYRO )
+            {
+                attitudeGetVector(sample.gyro);
+            }
+            cmdStore(sample.contents, sizeof(sample));
+            if ( settings.attitude_log == ATTITUDE_APPENDED )
+            {
+                attitudeGetVector(attitude.attitude);
+                cmdStore(attitude.contents, sizeof(attitude));
+            }
+            if ( row_buff != NULL )
+            {
+                if ( sample.row_valid == ROW_STORED )
+                {
+                    if ( !pixpackIsRaw() )
+                    {
+                        pixpackRow(sample.row_num, row_buff->pixels);
+                    }
+                    cmdStore(row_buff->pixels, pixpackRowSize());
+                }
+                cambuffReturnRow(row_buff);
+            }
 
-            // If buffer is about to overflow, write it to memory
-            if ( mem_byte > (DEFAULT_MEM_PAGE_SIZE - sizeof(sample)) )
+            // Samples are spaced out while the robot is quiet, but motor
+            // switches stay on the full-rate grid, and sampling goes back to
+            // full rate from them on, as motion is about to change
+            skip = sampleskipNext(rates, gyrobiasGet(), sample.bemf);
+            if ( slot < args.sample_motor_on &&
+                 slot + skip >= args.sample_motor_on )
+            {
+                skip = args.sample_motor_on - slot;
+                sampleskipReset();
+            }
+            if ( slot < args.sample_motor_off &&
+                 slot + skip >= args.sample_motor_off )
             {
-                dfmemWriteBuffer2MemoryNoErase ( mem_page++, buffer );
-                buffer  ^= 0x1;  // toggle between buffer 0 and 1
-                mem_byte = 0;
+                skip = args.sample_motor_off - slot;
+                sampleskipReset();
             }
+            slot += skip;
 
             // Control motor during sampling
-            if ( count == sample_motor_on )
+            if ( profileIsRunning() )
+            {
+                // Motors are driven by the profile playback
+            } else if ( slot == args.sample_motor_on && !profileIsHolding() )
             {
-                mcSetDutyCycle(MC_CHANNEL_PWM1, settings.motor_duty_cycle);
-            } else if ( count == sample_motor_off ) {
-                mcSetDutyCycle(MC_CHANNEL_PWM1, 0);
+                if ( settings.speed_ctrl )
+                {
+                    mcSpeedCtrlStart();
+                } else {
+                    mcSetPdc(MC_CHANNEL_PWM1, motor_pdc);
+                }
+            } else if ( slot == args.sample_motor_off ) {
+                profileStop();  // ends the hold of its last point, if any
+                mcSpeedCtrlStop();
+                mcSetPdc(MC_CHANNEL_PWM1, 0);
             }
 
-            next_sample_time += settings.sampling_period;
+            next_sample_time += skip * settings.sampling_period;
+        } else if ( settings.attitude_period &&
+                    sclockGetTime() > next_gyro_time ) {
+            // Integrating at the gyro's own rate, rather than once per
+            // sample, keeps fast motion from aliasing into the attitude
+            next_gyro_time = sclockGetTime();
+            gyroGetXYZ((unsigned char *) gyro);
+            attitudeUpdate(gyro, gyrobiasGet(), next_gyro_time);
+            next_gyro_time += settings.attitude_period;
         }
-    } while (count < samples);
+    } while ( slot < args.samples &&
+              cmdStoreRoom() >= cmdSampleSize() );
 
     camStop(); // Disable camera capture interrupt
 
+    runstatsFinish(slot, cambuffGetOverruns());
+
+    profileStop();
+    if ( settings.steer_ctrl ) mcSteerPdc(0);
+
+    cmdStoreFlush(); // Write out the last, partially filled, page
+
+    cmdUpdateGyroBias();
+
+    entry.pages   = store.page - entry.start_page; // as rows may be left out
+    entry.samples = count;
+    catalogAppend(&entry);
+
     LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
 }
 
@@ -305,56 +699,42 @@ static void cmdReadMemory (unsigned char status,
                            unsigned char length,
                            unsigned char *frame)
 {
-    unsigned int samples       = frame[0] + (frame[1] << 8),
-                 pld_size      = frame[2] + (frame[3] << 8),
-                 mem_byte      = 0,
-                 mem_page      = settings.mem_page_start,
-                 mem_page_last = settings.mem_page_start + samples/3;
-    unsigned char count = 0;
+    ReadMemoryArgs  args;
+    RunEntryRecord *entry = catalogGetRun(catalogGetRuns() - 1);
 
-    MacPacket packet;
-    Payload pld;
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
 
-    LED_GREEN = 1; LED_RED = 0; LED_ORANGE = 0;
-
-    do
+    // Reads the latest run
+    if ( entry != NULL )
     {
-        do
-        {
-            radioProcess();
-            packet = radioRequestPacket(pld_size);
-            if ( packet == NULL ) continue;
-            macSetDestPan(packet, PAN_ID);
-            macSetDestAddr(packet, DEST_ADDR);
-
-            pld = macGetPayload(packet);
-            dfmemRead ( mem_page, mem_byte, pld_size, payGetData(pld) );
-            paySetStatus(pld, count++);
-            paySetType(pld, CMD_READ_MEMORY);
-
-            while ( !radioEnqueueTxPacket(packet) ) radioProcess();
-            //while ( trxGetLastACKd() )              radioProcess();
-
-            mem_byte += pld_size;
-
-        } while ( mem_byte <= (DEFAULT_MEM_PAGE_SIZE - pld_size) );
-
-        mem_page++;
-        mem_byte = 0;
+        read_page_start = entry->start_page;
+        cmdSendPages(CMD_READ_MEMORY, read_page_start, entry->pages,
+                                                            args.pld_size);
+    } else {
+        read_page_start = settings.mem_page_start;
+        cmdSendPages(CMD_READ_MEMORY, read_page_start,
+                            cmdCountPages(args.samples), args.pld_size);
+    }
+}
 
-        if ( mem_page & DEFAULT_MEM_SECTOR_SIZE ) LED_GREEN = ~LED_GREEN;
+static void cmdReadPages (unsigned char status,
+                          unsigned char length,
+                          unsigned char *frame)
+{
+    ReadPagesArgs args;
 
-    } while ( mem_page < mem_page_last );
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
 
-    LED_GREEN = 1; LED_RED = 1; LED_ORANGE = 1;
-    delay_ms(2000);
-    LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
+    cmdSendPages(CMD_READ_PAGES, read_page_start + args.first,
+                        args.count, args.pld_size);
 }
 
 static void cmdGetSettings (unsigned char status,
                             unsigned char length,
                             unsigned char *frame)
 {
+    cmdUpdateGyroBias();
+
     radioSendData(DEST_ADDR, 0, CMD_GET_SETTINGS,
                     sizeof(settings), settings.contents, RADIO_DATA_SAFE);
 }
@@ -363,42 +743,753 @@ static void  cmdSetSamplingPeriod (unsigned char status,
                                    unsigned char length,
                                    unsigned char *frame)
 {
-    settings.sampling_period = frame[0] + (frame[1] << 8);
+    SetSamplingPeriodArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.sampling_period = args.sampling_period;
 }
 
 static void  cmdSetMemoryPageStart (unsigned char status,
                                     unsigned char length,
                                     unsigned char *frame)
 {
-    settings.mem_page_start = frame[0] + (frame[1] << 8);
+    SetMemoryPageStartArgs args;
+    unsigned long page;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    // Runs start on a sector of their own, so erasing never hits the catalog
+    page = args.mem_page_start;
+    if ( page < CATALOG_PAGE + MEM_SECTOR_SIZE )
+        page = CATALOG_PAGE + MEM_SECTOR_SIZE;
+    page += MEM_SECTOR_SIZE - 1;
+    page -= page % MEM_SECTOR_SIZE;
+    if ( page > MEM_PAGE_COUNT ) page = MEM_PAGE_COUNT;
+
+    settings.mem_page_start = (unsigned int) page;
 }
 
 static void cmdSetMotorSpeed (unsigned char status,
                               unsigned char length,
                               unsigned char *frame)
 {
-    // TODO (fgb) : Simplify extraction of frame
-    unsigned char dc_chr[4];
-    float *duty_cycle = (float *) dc_chr;
+    SetMotorSpeedArgs args;
 
-    dc_chr[0] = frame[0];
-    dc_chr[1] = frame[1];
-    dc_chr[2] = frame[2];
-    dc_chr[3] = frame[3];
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
 
-    settings.motor_duty_cycle = *duty_cycle;
+    settings.motor_duty_cycle = args.motor_duty_cycle;
+    motor_pdc = mcDutyCycleToPdc(settings.motor_duty_cycle);
 }
 
 static void cmdCalibrateGyro (unsigned char status,
                               unsigned char length,
                               unsigned char *frame)
 {
+    float *offset;
+    int    bias[3];
+    unsigned int i;
+
     LED_GREEN = 1; LED_RED = 0; LED_ORANGE = 1;
 
     gyroRunCalib(2000);
 
-    radioSendData(DEST_ADDR, 0, CMD_CALIBRATE_GYRO,
-                    3*sizeof(float), gyroGetCalibParam(), RADIO_DATA_SAFE);
+    // Seed the online estimate, which takes over from here on
+    offset = (float *) gyroGetCalibParam();
+    for ( i = 0; i < 3; i++ )
+    {
+        bias[i] = (int) (offset[i] * (1 << GYROBIAS_FRAC_BITS));
+    }
+    gyrobiasSeed(bias);
+    cmdUpdateGyroBias();
+
+    radioSendData(DEST_ADDR, 0, CMD_CALIBRATE_GYRO, sizeof(GyroCalibRecord),
+                                    gyroGetCalibParam(), RADIO_DATA_SAFE);
 
     LED_GREEN = 0; LED_ORANGE = 0;
 }
+
+static void cmdSetRowSchedule (unsigned char status,
+                               unsigned char length,
+                               unsigned char *frame)
+{
+    SetRowScheduleArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    cambuffSetSchedule(args.mode, args.period, args.phase, args.row_mask);
+    memcpy ( row_schedule.contents, args.contents, sizeof(args) );
+}
+
+static void cmdSetRowGate (unsigned char status,
+                           unsigned char length,
+                           unsigned char *frame)
+{
+    SetRowGateArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.row_gate = args.row_gate;
+    camgateSetThreshold(settings.row_gate);
+}
+
+static void cmdSetSteerCtrl (unsigned char status,
+                             unsigned char length,
+                             unsigned char *frame)
+{
+    SetSteerCtrlArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.steer_kp    = args.steer_kp;
+    settings.steer_kd    = args.steer_kd;
+    settings.steer_derot = args.steer_derot;
+    settings.steer_ctrl  = args.steer_ctrl;
+
+    flowsteerSetGains(settings.steer_kp, settings.steer_kd);
+    flowsteerSetDerotation(settings.steer_derot);
+}
+
+static void cmdGetSteerStats (unsigned char status,
+                              unsigned char length,
+                              unsigned char *frame)
+{
+    radioSendData(DEST_ADDR, 0, CMD_GET_STEER_STATS, sizeof(steer_stats),
+                                    steer_stats.contents, RADIO_DATA_SAFE);
+}
+
+static void cmdGetRunSummary (unsigned char status,
+                              unsigned char length,
+                              unsigned char *frame)
+{
+    radioSendData(DEST_ADDR, 0, CMD_GET_RUN_SUMMARY, sizeof(RunSummaryRecord),
+                            runstatsGet()->contents, RADIO_DATA_SAFE);
+}
+
+static void cmdCalibrateRows (unsigned char status,
+                              unsigned char length,
+                              unsigned char *frame)
+{
+    CalibrateRowsArgs args;
+    CamRow row;
+    unsigned long timeout;
+    unsigned int  sum[ROW_SIZE];    // only needed while calibrating
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    LED_GREEN = 0; LED_RED = 1; LED_ORANGE = 1;
+
+    // Rows are averaged as the camera gives them, before any correction
+    rowcorrCalibStart(args.phase, sum);
+    timeout = sclockGetTime() + ROW_CALIB_TIMEOUT;
+    camStart();
+    while ( rowcorrCalibRows() < args.rows && sclockGetTime() < timeout )
+    {
+        if ( cambuffHasNewRow() )
+        {
+            row = cambuffGetRow();
+            rowcorrCalibAddRow(sum, row->pixels);
+            cambuffReturnRow(row);
+        }
+    }
+    camStop();
+    while ( cambuffHasNewRow() ) cambuffReturnRow(cambuffGetRow());
+
+    rowcorrCalibFinish(sum);
+
+    LED_RED = 0; LED_ORANGE = 0;
+
+    // Answers with the table it ended up with
+    cmdGetRowCorr(status, 0, NULL);
+}
+
+static void cmdSetRowCorr (unsigned char status,
+                           unsigned char length,
+                           unsigned char *frame)
+{
+    SetRowCorrArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    rowcorrEnable(args.enabled);
+}
+
+static void cmdGetRowCorr (unsigned char status,
+                           unsigned char length,
+                           unsigned char *frame)
+{
+    RowCorrInfoRecord  info;
+    RowCorrChunkRecord chunk;
+    unsigned char buffer[ROW_SIZE];
+    unsigned int  i, j;
+    unsigned long start_time;
+
+    info.enabled    = rowcorrIsEnabled();
+    info.calibrated = rowcorrCalibDone();
+    info.rows       = rowcorrCalibRows();
+    info.phase      = rowcorrCalibPhase();
+    info.level      = rowcorrCalibLevel();
+
+    // Both passes timed over the same row, with the table as it stands. Rows
+    // are corrected in place, so the row is filled again before each one.
+    info.bench_rows   = ROW_CORR_BENCH_ROWS;
+    info.bench_time   = 0;
+    info.bench_time_c = 0;
+    for ( i = 0; i < ROW_CORR_BENCH_ROWS; i++ )
+    {
+        memset ( buffer, 0x80, sizeof(buffer) );
+        start_time = sclockGetTime();
+        rowcorrApply(buffer);
+        info.bench_time += sclockGetTime() - start_time;
+
+        memset ( buffer, 0x80, sizeof(buffer) );
+        start_time = sclockGetTime();
+        rowcorrApplyC(buffer);
+        info.bench_time_c += sclockGetTime() - start_time;
+    }
+
+    radioSendData(DEST_ADDR, 0, CMD_GET_ROW_CORR, sizeof(info),
+                                        info.contents, RADIO_DATA_SAFE);
+    radioProcess();
+
+    // Then the table, a chunk of columns per packet from status 1
+    for ( i = 0; i < ROW_SIZE; i += ROW_CORR_CHUNK )
+    {
+        chunk.first = i;
+        for ( j = 0; j < ROW_CORR_CHUNK; j++ )
+        {
+            chunk.offset[j] = rowcorrGetOffset(i + j);
+            chunk.gain[j]   = rowcorrGetGain(i + j);
+        }
+        radioSendData(DEST_ADDR, i / ROW_CORR_CHUNK + 1, CMD_GET_ROW_CORR,
+                        sizeof(chunk), chunk.contents, RADIO_DATA_SAFE);
+        radioProcess();
+    }
+}
+
+static void cmdSetSampleSkip (unsigned char status,
+                              unsigned char length,
+                              unsigned char *frame)
+{
+    SetSampleSkipArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.skip_gyro_full  = args.skip_gyro_full;
+    settings.skip_bemf_full  = args.skip_bemf_full;
+    settings.sample_skip_max = args.sample_skip_max;
+
+    sampleskipSetup(settings.sample_skip_max, settings.skip_gyro_full,
+                                              settings.skip_bemf_full);
+}
+
+static void cmdSetPixelDepth (unsigned char status,
+                              unsigned char length,
+                              unsigned char *frame)
+{
+    SetPixelDepthArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.pixel_depth   = args.pixel_depth;
+    settings.pixel_compand = args.pixel_compand;
+    settings.pixel_dither  = args.pixel_dither;
+
+    // Unsupported values fall back on 8 bits, as the host assumes too
+    pixpackSetup(settings.pixel_depth, settings.pixel_compand,
+                                       settings.pixel_dither);
+}
+
+static void cmdSetAttitude (unsigned char status,
+                            unsigned char length,
+                            unsigned char *frame)
+{
+    SetAttitudeArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.attitude_period = args.attitude_period;
+
+    // Nothing is logged without integration, which a run header tells
+    if ( args.attitude_period == 0 || args.attitude_log > ATTITUDE_IN_GYRO )
+    {
+        settings.attitude_log = ATTITUDE_OFF;
+    } else {
+        settings.attitude_log = args.attitude_log;
+    }
+}
+
+static void cmdSetSpeedCtrl (unsigned char status,
+                             unsigned char length,
+                             unsigned char *frame)
+{
+    SetSpeedCtrlArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    settings.speed_setpoint = args.speed_setpoint;
+    settings.speed_kp       = args.speed_kp;
+    settings.speed_ki       = args.speed_ki;
+    settings.speed_ctrl     = args.speed_ctrl;
+
+    speedctrlSetSetpoint(settings.speed_setpoint);
+    speedctrlSetGains(settings.speed_kp, settings.speed_ki);
+}
+
+static void cmdSetProfile (unsigned char status,
+                           unsigned char length,
+                           unsigned char *frame)
+{
+    SetProfileArgs      args;
+    ProfilePointRecord  record;
+    ProfilePointStruct  point;
+    ProfileLengthRecord reply;
+    unsigned int i;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+    frame  += sizeof(args);
+    length -= sizeof(args);
+
+    if ( args.first == 0 ) profileClear();
+
+    for ( i = 0; i < args.count; i++ )
+    {
+        if ( !LAYOUT_UNPACK(record, frame, length) ) break;
+        frame  += sizeof(record);
+        length -= sizeof(record);
+
+        point.time   = record.time;
+        point.thrust = record.thrust;
+        point.steer  = record.steer;
+        if ( !profileSetPoint(args.first + i, &point) ) break;
+    }
+
+    // Points out of order, in index or time, or past the table are dropped,
+    // along with the rest of the chunk
+    reply.length  = profileGetLength();
+    reply.dropped = args.count - i;
+    radioSendData(DEST_ADDR, 0, CMD_SET_PROFILE,
+                    sizeof(reply), reply.contents, RADIO_DATA_SAFE);
+}
+
+static void cmdListRuns (unsigned char status,
+                         unsigned char length,
+                         unsigned char *frame)
+{
+    unsigned int i;
+
+    for ( i = 0; i < catalogGetRuns(); i++ )
+    {
+        radioSendData(DEST_ADDR, i, CMD_LIST_RUNS, sizeof(RunEntryRecord),
+                            catalogGetRun(i)->contents, RADIO_DATA_SAFE);
+        radioProcess();
+    }
+}
+
+static void cmdReadRun (unsigned char status,
+                        unsigned char length,
+                        unsigned char *frame)
+{
+    ReadRunArgs     args;
+    RunEntryRecord *entry;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+    if ( (entry = catalogGetRun(args.run)) == NULL ) return;
+
+    read_page_start = entry->start_page;
+
+    cmdSendPages(CMD_READ_RUN, entry->start_page, entry->pages,
+                                                            args.pld_size);
+}
+
+static void cmdClearCatalog (unsigned char status,
+                             unsigned char length,
+                             unsigned char *frame)
+{
+    catalogClear();
+}
+
+static void cmdTimeSync (unsigned char status,
+                         unsigned char length,
+                         unsigned char *frame)
+{
+    TimeSyncArgs   args;
+    TimeSyncRecord record;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    // Answer right away, the host times the round trip around it
+    record.time = sclockGetTime();
+    record.seq  = args.seq;
+
+    radioSendData(DEST_ADDR, status, CMD_TIME_SYNC, sizeof(record),
+                                        record.contents, RADIO_DATA_SAFE);
+}
+
+static void cmdGetReadStats (unsigned char status,
+                             unsigned char length,
+                             unsigned char *frame)
+{
+    unsigned char i;
+
+    // Totals first, then the timeline, one slice per packet from status 1
+    radioSendData(DEST_ADDR, 0, CMD_GET_READ_STATS, sizeof(read_stats),
+                                    read_stats.contents, RADIO_DATA_SAFE);
+    radioProcess();
+    for ( i = 0; i < READ_SLICES; i++ )
+    {
+        radioSendData(DEST_ADDR, i + 1, CMD_GET_READ_STATS,
+                            sizeof(ReadSliceRecord), read_slices[i].contents,
+                            RADIO_DATA_SAFE);
+        radioProcess();
+    }
+}
+
+static void cmdSetSequence (unsigned char status,
+                            unsigned char length,
+                            unsigned char *frame)
+{
+    SetSequenceArgs    args;
+    SequenceStepRecord step;
+    unsigned int i;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+    frame  += sizeof(args);
+    length -= sizeof(args);
+
+    // Steps were checked as the sequence started, so they cannot change
+    // while it runs. A new table stops it instead, which the host is told.
+    if ( sequenceGetProgress()->state == SEQ_RUNNING )
+    {
+        if ( args.first != 0 ) return;
+        sequenceClear();
+        cmdSendSequenceProgress();
+    } else if ( args.first == 0 ) {
+        sequenceClear();
+    }
+
+    for ( i = 0; i < args.count; i++ )
+    {
+        if ( !LAYOUT_UNPACK(step, frame, length) ) return;
+        frame  += sizeof(step);
+        length -= sizeof(step);
+
+        sequenceSetStep(args.first + i, &step);
+    }
+}
+
+static void cmdRunSequence (unsigned char status,
+                            unsigned char length,
+                            unsigned char *frame)
+{
+    RunSequenceArgs args;
+
+    if ( !LAYOUT_UNPACK(args, frame, length) ) return;
+
+    if ( args.run )
+    {
+        seq_timestamp  = args.timestamp;
+        seq_start_time = sclockGetTime();
+        sequenceStart(seq_start_time);
+    } else {
+        sequenceStop();
+    }
+
+    // Failing to start, or stopping, is reported here, the rest as it runs
+    if ( sequenceGetProgress()->state != SEQ_RUNNING )
+    {
+        cmdSendSequenceProgress();
+    }
+}
+
+static void cmdDispatch (unsigned char command,
+                         unsigned char status,
+                         unsigned char length,
+                         unsigned char *frame)
+{
+    unsigned int i;
+
+    // Commands without a handler are dropped
+    for ( i = 0; i < CMD_TABLE_SIZE; i++ )
+    {
+        if ( cmd_table[i].id == command )
+        {
+            cmd_table[i].handler(status, length, frame);
+            break;
+        }
+    }
+}
+
+static void cmdSendSequenceProgress (void)
+{
+    SequenceProgressRecord *progress = sequenceGetProgress();
+
+    radioSendData(DEST_ADDR, progress->state, CMD_RUN_SEQUENCE,
+                    sizeof(*progress), progress->contents, RADIO_DATA_SAFE);
+}
+
+static void cmdSendPages (unsigned char type,
+                          unsigned int page,
+                          unsigned int count,
+                          unsigned int pld_size)
+{
+    static unsigned char pkt_count; // keeps counting across page requests
+    unsigned char buffer = 0;
+    unsigned char queued;
+    unsigned int  mem_byte,
+                  mem_page_last = page + count;
+    unsigned long start_time, wait_time, page_time;
+    ReadSliceRecord *slice;
+
+    MacPacket packet;
+    Payload pld;
+
+    if ( pld_size == 0 || pld_size > MEM_PAGE_SIZE ) return;
+    if ( type != CMD_READ_PAGES )
+    {
+        pkt_count = 0;
+        memset ( read_stats.contents, 0, sizeof(read_stats) );
+        memset ( read_slices, 0, sizeof(read_slices) );
+        read_tx_taken       = 0;
+        read_first_page     = page;
+        read_pages          = count;
+        read_stats.txq_size = TXPQ_MAX_SIZE;
+    }
+    read_stats.pld_size = pld_size;
+
+    LED_GREEN = 1; LED_RED = 0; LED_ORANGE = 0;
+
+    start_time = sclockGetTime();
+
+    // Pages are moved whole into one DataFlash buffer, and packets are read
+    // out of it, while the next page moves into the other one
+    if ( page < mem_page_last )
+    {
+        wait_time = sclockGetTime();
+        dfmemReadPage2Buffer(page, buffer);
+        read_stats.flash_wait += sclockGetTime() - wait_time;
+    }
+
+    while ( page < mem_page_last )
+    {
+        // Pages requested again add up in the slices they were first sent in
+        slice = &read_slices[(page - read_first_page < read_pages) ?
+                    (unsigned long) (page - read_first_page) * READ_SLICES /
+                                            read_pages : READ_SLICES - 1];
+        page_time = sclockGetTime();
+
+        if ( page + 1 < mem_page_last )
+        {
+            // Waits for the transfer of this page, if still in progress
+            wait_time = sclockGetTime();
+            dfmemReadPage2Buffer(page + 1, buffer ^ 0x1);
+            read_stats.flash_wait += sclockGetTime() - wait_time;
+        }
+
+        mem_byte = 0;
+
+        do
+        {
+            wait_time = sclockGetTime();
+            cmdProcessReadTx(slice);
+            packet = radioRequestPacket(pld_size);
+            read_stats.radio_wait += sclockGetTime() - wait_time;
+            if ( packet == NULL )
+            {
+                read_stats.request_retries++;
+                continue;
+            }
+            macSetDestPan(packet, PAN_ID);
+            macSetDestAddr(packet, DEST_ADDR);
+
+            pld = macGetPayload(packet);
+            wait_time = sclockGetTime();
+            dfmemReadBuffer(buffer, mem_byte, pld_size, payGetData(pld));
+            read_stats.flash_wait += sclockGetTime() - wait_time;
+            paySetStatus(pld, pkt_count++);
+            paySetType(pld, type);
+
+            wait_time = sclockGetTime();
+            while ( !radioEnqueueTxPacket(packet) )
+            {
+                read_stats.enqueue_retries++;
+                slice->enqueue_retries++;
+                cmdProcessReadTx(slice);
+            }
+            read_stats.radio_wait += sclockGetTime() - wait_time;
+
+            // How far ahead of the radio the flash keeps the queue
+            queued = radioGetTxQueueSize();
+            read_stats.txq_sum += queued;
+            slice->txq_sum     += queued;
+            if ( queued > read_stats.txq_max ) read_stats.txq_max = queued;
+
+            read_stats.packets++;
+            slice->packets++;
+            mem_byte += pld_size;
+
+        } while ( mem_byte <= (MEM_PAGE_SIZE - pld_size) );
+
+        read_stats.pages++;
+        slice->pages++;
+        slice->time += sclockGetTime() - page_time;
+        buffer ^= 0x1;
+        page++;
+
+        if ( page & MEM_SECTOR_SIZE ) LED_GREEN = ~LED_GREEN;
+    }
+
+    read_stats.time += sclockGetTime() - start_time;
+
+    LED_GREEN = 1; LED_RED = 1; LED_ORANGE = 1;
+    delay_ms(2000);
+    LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
+}
+
+static void cmdProcessReadTx (ReadSliceRecord *slice)
+{
+    unsigned char queued = radioGetTxQueueSize();
+
+    radioProcess();
+
+    // The radio takes the next packet only once done with the last one, so
+    // that is when the last one's outcome is known. The driver leaves MAC
+    // retries to the transceiver, which does not count them.
+    if ( radioGetTxQueueSize() < queued )
+    {
+        if ( read_tx_taken++ > 0 )
+        {
+            read_stats.acks_checked++;
+            if ( !trxGetLastACKd() )
+            {
+                read_stats.ack_fails++;
+                slice->ack_fails++;
+            }
+        }
+    }
+}
+
+// At most, with its attitude if logged after it and a row
+static unsigned int cmdSampleSize (void)
+{
+    unsigned int size = sizeof(sample) + pixpackRowSize();
+
+    if ( settings.attitude_log == ATTITUDE_APPENDED )
+    {
+        size += sizeof(AttitudeRecord);
+    }
+
+    return size;
+}
+
+static unsigned int cmdCountPages (unsigned long samples)
+{
+    unsigned int size = cmdSampleSize();
+
+    // At most, as samples without a row stored take less, and saturating
+    // at the whole flash rather than overflowing
+    if ( samples > (unsigned long) MEM_PAGE_COUNT * MEM_PAGE_DATA_SIZE / size )
+    {
+        return MEM_PAGE_COUNT;
+    }
+
+    return (samples * size
+            + sizeof(RunHeaderRecord) + MEM_PAGE_DATA_SIZE - 1)
+                                                        / MEM_PAGE_DATA_SIZE;
+}
+
+static void cmdStoreStart (unsigned int page)
+{
+    store.page = page;
+    store.byte = 0;
+    store.crc  = CRC_INIT;
+}
+
+static void cmdStore (unsigned char *data, unsigned int length)
+{
+    unsigned int chunk;
+
+    while ( length > 0 )
+    {
+        chunk = MEM_PAGE_DATA_SIZE - store.byte;
+        if ( chunk > length ) chunk = length;
+
+        dfmemWriteBuffer(data, chunk, store.byte, store.buffer);
+        store.crc   = crcUpdate(store.crc, data, chunk);
+        store.byte += chunk;
+        data       += chunk;
+        length     -= chunk;
+
+        // If buffer is full, write it to memory
+        if ( store.byte == MEM_PAGE_DATA_SIZE ) cmdStoreFlush();
+    }
+}
+
+static void cmdStoreFlush (void)
+{
+    static unsigned char padding[16]; // zeros
+    unsigned char crc[2];
+    unsigned int  chunk;
+
+    if ( store.byte == 0 ) return;
+
+    // Pad a partially filled page, so that its CRC covers known contents
+    while ( store.byte < MEM_PAGE_DATA_SIZE )
+    {
+        chunk = MEM_PAGE_DATA_SIZE - store.byte;
+        if ( chunk > sizeof(padding) ) chunk = sizeof(padding);
+
+        dfmemWriteBuffer(padding, chunk, store.byte, store.buffer);
+        store.crc   = crcUpdate(store.crc, padding, chunk);
+        store.byte += chunk;
+    }
+
+    crc[0] = store.crc & 0xFF;
+    crc[1] = store.crc >> 8;
+    dfmemWriteBuffer(crc, sizeof(crc), MEM_PAGE_DATA_SIZE, store.buffer);
+
+    dfmemWriteBuffer2MemoryNoErase ( store.page++, store.buffer );
+    store.buffer ^= 0x1;  // toggle between buffer 0 and 1
+    store.byte    = 0;
+    store.crc     = CRC_INIT;
+}
+
+static unsigned long cmdStoreRoom (void)
+{
+    // [bytes] left before the end of the flash
+    return (unsigned long) (MEM_PAGE_COUNT - store.page) * MEM_PAGE_DATA_SIZE
+                                                                - store.byte;
+}
+
+static void cmdSteerStep (unsigned long frame_ts, unsigned long detect_ts)
+{
+    unsigned long pwm_ts, latency;
+
+    // The frame was complete with its last row, captured at frame_ts, but
+    // only known to be once a row of the next one came in, at detect_ts
+    mcSteerPdc(flowsteerGetOutput());
+    pwm_ts  = sclockGetTime();
+    latency = pwm_ts - frame_ts;
+
+    sample.steer_pdc     = flowsteerGetOutput();
+    sample.steer_latency = (latency > 0xFFFF) ? 0xFFFF : latency;
+
+    steer_stats.steps++;
+    steer_stats.latency_sum += latency;
+    if ( latency > steer_stats.latency_max ) steer_stats.latency_max = latency;
+    if ( detect_ts - frame_ts > steer_stats.detect_max )
+    {
+        steer_stats.detect_max = detect_ts - frame_ts;
+    }
+    if ( pwm_ts - detect_ts > steer_stats.compute_max )
+    {
+        steer_stats.compute_max = pwm_ts - detect_ts;
+    }
+}
+
+static void cmdUpdateGyroBias (void)
+{
+    memcpy ( settings.gyro_bias, gyrobiasGet(), sizeof(settings.gyro_bias) );
+    settings.gyro_bias_conf = gyrobiasGetConfidence();
+    settings.gyro_bias_age  = gyrobiasGetAge();
+}
@@ -39,11 +39,15 @@
 #define __CMD_H
 
 
-void cmdSetup (void);
-
 void cmdResetSettings (void);
 
 void cmdHandleRadioRxBuffer (void);
 
+void cmdTrackGyroBias (void);
+
+// Runs the next step of the sequence uploaded with CMD_SET_SEQUENCE, if one
+// is running and due, see sequence.h.
+void cmdProcessSequence (void);
+
 
 #endif // __CMD_H
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Reactive steering from visual flow
+ */
+
+#include "flowsteer.h"
+
+
+// =========== Static Variables ===============================================
+static int out_max;
+static int kp, kd;
+static int derotation;
+
+static unsigned int  sum[FLOWSTEER_BINS];     // of row means, this frame
+static unsigned int  rows;
+static unsigned char last_row_num;
+static unsigned char profile[FLOWSTEER_BINS]; // of the last complete frame
+static unsigned char previous[FLOWSTEER_BINS];
+static unsigned char frames;                  // complete, saturating at 3
+static long rotation;                         // sum of yaw rates, this frame
+
+static int flow[2];
+static int imbalance;
+static int output;
+
+// =========== Function Stubs =================================================
+static void closeFrame(void);
+static int estimateFlow(unsigned char first, unsigned char last);
+
+// =========== Public Functions ===============================================
+
+void flowsteerSetup(int max)
+{
+    out_max    = max;
+    kp         = 0;
+    kd         = 0;
+    derotation = 0;
+
+    flowsteerReset();
+}
+
+void flowsteerSetGains(int p, int d)
+{
+    kp = p;
+    kd = d;
+}
+
+void flowsteerSetDerotation(int scale)
+{
+    derotation = scale;
+}
+
+void flowsteerReset(void)
+{
+    unsigned char i;
+
+    for ( i = 0; i < FLOWSTEER_BINS; i++ ) sum[i] = 0;
+    rows         = 0;
+    last_row_num = 0;
+    frames       = 0;
+    rotation     = 0;
+
+    flow[FLOWSTEER_LEFT]  = 0;
+    flow[FLOWSTEER_RIGHT] = 0;
+    imbalance = 0;
+    output    = 0;
+}
+
+unsigned char flowsteerAddRow(unsigned char row_num, unsigned char *pixels,
+                              unsigned char is_last)
+{
+    unsigned char i, j, is_complete = 0;
+    unsigned int  bin;
+
+    // The last row of the frame went missing
+    if ( rows > 0 && row_num < last_row_num )
+    {
+        closeFrame();
+        is_complete = (frames > 1);
+    }
+
+    for ( i = 0; i < FLOWSTEER_BINS; i++ )
+    {
+        bin = 0;
+        for ( j = 0; j < FLOWSTEER_BIN_SIZE; j++ ) bin += *pixels++;
+        sum[i] += bin >> FLOWSTEER_BIN_SHIFT;
+    }
+    rows++;
+    last_row_num = row_num;
+
+    if ( is_last )
+    {
+        closeFrame();
+        is_complete = (frames > 1);
+    }
+
+    return is_complete;
+}
+
+void flowsteerAddRotation(int rate, unsigned char periods)
+{
+    rotation += (long) rate * periods;
+}
+
+int flowsteerGetOutput(void)
+{
+    return output;
+}
+
+int flowsteerGetFlow(unsigned char side)
+{
+    return flow[side];
+}
+
+int flowsteerGetImbalance(void)
+{
+    return imbalance;
+}
+
+// =========== Private Functions ==============================================
+
+static void closeFrame(void)
+{
+    unsigned char i;
+    int  magnitude[2], last_imbalance = imbalance, rotational;
+    long out;
+
+    for ( i = 0; i < FLOWSTEER_BINS; i++ )
+    {
+        previous[i] = profile[i];
+        profile[i]  = (unsigned char) (sum[i] / rows);
+        sum[i]      = 0;
+    }
+    rows = 0;
+
+    // Rotation over the frame, as flow common to both halves
+    rotational = (int) ((rotation * derotation) >> FLOWSTEER_DEROT_SHIFT);
+    rotation   = 0;
+
+    if ( frames < 2 ) frames++;
+    if ( frames < 2 ) return;
+
+    // The outermost bins lack a neighbour for the spatial gradient
+    flow[FLOWSTEER_LEFT]  = estimateFlow(1, FLOWSTEER_BINS / 2)
+                                                            - rotational;
+    flow[FLOWSTEER_RIGHT] = estimateFlow(FLOWSTEER_BINS / 2,
+                                        FLOWSTEER_BINS - 1) - rotational;
+
+    magnitude[FLOWSTEER_LEFT]  = (flow[FLOWSTEER_LEFT] < 0) ?
+                            -flow[FLOWSTEER_LEFT] : flow[FLOWSTEER_LEFT];
+    magnitude[FLOWSTEER_RIGHT] = (flow[FLOWSTEER_RIGHT] < 0) ?
+                            -flow[FLOWSTEER_RIGHT] : flow[FLOWSTEER_RIGHT];
+
+    if ( magnitude[FLOWSTEER_LEFT] + magnitude[FLOWSTEER_RIGHT] > 0 )
+    {
+        imbalance = (int) ((((long) magnitude[FLOWSTEER_LEFT]
+                                - magnitude[FLOWSTEER_RIGHT])
+                                << FLOWSTEER_FLOW_SHIFT)
+                / ((long) magnitude[FLOWSTEER_LEFT]
+                                + magnitude[FLOWSTEER_RIGHT]));
+    } else {
+        imbalance = 0;
+    }
+
+    // No change to go by on the first frame
+    if ( frames < 3 )
+    {
+        last_imbalance = imbalance;
+        frames++;
+    }
+
+    out = ((long) kp * imbalance
+            + (long) kd * (imbalance - last_imbalance))
+                                                >> FLOWSTEER_FLOW_SHIFT;
+    if ( out >  out_max ) out =  out_max;
+    if ( out < -out_max ) out = -out_max;
+    output = (int) out;
+}
+
+static int estimateFlow(unsigned char first, unsigned char last)
+{
+    unsigned char i;
+    int  ix, it;
+    long sxx = 0, sxt = 0, f;
+
+    // Least squares fit of It = -flow * Ix, with the central difference Ix
+    // being twice the gradient
+    for ( i = first; i < last; i++ )
+    {
+        ix   = (int) profile[i + 1] - profile[i - 1];
+        it   = (int) profile[i] - previous[i];
+        sxx += (long) ix * ix;
+        sxt += (long) ix * it;
+    }
+
+    if ( sxx < FLOWSTEER_MIN_TEXTURE ) return 0;  // nothing to track
+
+    f = -(sxt << (FLOWSTEER_FLOW_SHIFT + 1)) / sxx;
+    if ( f >  0x7FFF ) f =  0x7FFF;
+    if ( f < -0x7FFF ) f = -0x7FFF;
+    return (int) f;
+}
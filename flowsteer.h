@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Reactive steering from visual flow
+ */
+
+#ifndef __FLOWSTEER_H
+#define __FLOWSTEER_H
+
+
+#include "layout.h"
+
+// Steers away from the image half with the most flow, centring the robot.
+#define FLOWSTEER_BIN_SHIFT     (2)
+#define FLOWSTEER_BIN_SIZE      (1 << FLOWSTEER_BIN_SHIFT)    // [pixels]
+#define FLOWSTEER_BINS          (ROW_SIZE >> FLOWSTEER_BIN_SHIFT)
+#define FLOWSTEER_FLOW_SHIFT    (8)
+#define FLOWSTEER_MIN_TEXTURE   (256)   // sum of squared gradients for flow
+#define FLOWSTEER_DEROT_SHIFT   (16)
+
+#define FLOWSTEER_LEFT          (0)
+#define FLOWSTEER_RIGHT         (1)
+
+
+void flowsteerSetup(int out_max);
+
+// Output [duty cycle register value] at full imbalance, and at a change of
+// full imbalance over a frame.
+void flowsteerSetGains(int kp, int kd);
+
+// Flow removed per yaw rate: scale * sum(rate) >> FLOWSTEER_DEROT_SHIFT.
+void flowsteerSetDerotation(int scale);
+
+// Drops the frame in progress and the previous one, e.g. between runs.
+void flowsteerReset(void);
+
+// Feeds a captured row, returning 1 if it completed a frame and the output
+// was updated, with the flow of that frame against the one before it. Frames
+// end on the row flagged as last or, if it was lost, on the next frame's.
+unsigned char flowsteerAddRow(unsigned char row_num, unsigned char *pixels,
+                              unsigned char is_last);
+
+// Feeds a bias-free yaw rate [raw gyro counts], once per sample, held over
+// the sampling periods since the previous one.
+void flowsteerAddRotation(int rate, unsigned char periods);
+
+int flowsteerGetOutput(void);
+
+// Flow of a side, after derotation, in bins per frame.
+int flowsteerGetFlow(unsigned char side);
+
+// (|left| - |right|) / (|left| + |right|).
+int flowsteerGetImbalance(void);
+
+
+#endif // __FLOWSTEER_H
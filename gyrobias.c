@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Online gyro bias estimation
+ */
+
+#include "gyrobias.h"
+
+
+#define WINDOW_SIZE     (1 << GYROBIAS_WINDOW_SHIFT)
+
+
+// =========== Static Variables ===============================================
+static int bias[3];
+static unsigned char confidence, age;
+
+static long sum[3], sum_sq[3];
+static unsigned int count;
+static unsigned char is_moving;
+
+// =========== Function Stubs =================================================
+static void resetWindow(void);
+static void closeWindow(void);
+
+// =========== Public Functions ===============================================
+
+void gyrobiasSetup(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < 3; i++ ) bias[i] = 0;
+
+    confidence = 0;
+    age        = 0;
+    resetWindow();
+}
+
+void gyrobiasUpdate(int *xyz)
+{
+    unsigned int i;
+    int dev;
+
+    // Accumulate deviations from the current estimate, which keeps the sums
+    // small and makes the variance cheap to compute
+    for ( i = 0; i < 3; i++ )
+    {
+        dev = xyz[i] - (bias[i] >> GYROBIAS_FRAC_BITS);
+
+        if ( dev > GYROBIAS_MAX_DEVIATION || dev < -GYROBIAS_MAX_DEVIATION )
+        {
+            is_moving = 1;
+            continue;
+        }
+
+        sum[i]    += dev;
+        sum_sq[i] += (long) dev * dev;
+    }
+
+    if ( ++count == WINDOW_SIZE ) closeWindow();
+}
+
+void gyrobiasSeed(int *new_bias)
+{
+    unsigned int i;
+
+    for ( i = 0; i < 3; i++ ) bias[i] = new_bias[i];
+
+    if ( confidence == 0 ) confidence = 1;
+    age = 0;
+
+    // The window in progress was accumulated against the old estimate
+    resetWindow();
+}
+
+int* gyrobiasGet(void)
+{
+    return bias;
+}
+
+unsigned char gyrobiasGetConfidence(void)
+{
+    return confidence;
+}
+
+unsigned char gyrobiasGetAge(void)
+{
+    return age;
+}
+
+// =========== Private Functions ==============================================
+
+static void closeWindow(void)
+{
+    unsigned int i;
+    long mean;
+    int window_bias;    // [counts] with GYROBIAS_FRAC_BITS
+    unsigned char is_stationary = !is_moving;
+
+    for ( i = 0; i < 3 && is_stationary; i++ )
+    {
+        mean = sum[i] >> GYROBIAS_WINDOW_SHIFT;
+        if ( (sum_sq[i] >> GYROBIAS_WINDOW_SHIFT) - mean * mean >=
+                                            GYROBIAS_VAR_THRESHOLD )
+        {
+            is_stationary = 0;
+        }
+    }
+
+    if ( is_stationary )
+    {
+        for ( i = 0; i < 3; i++ )
+        {
+            mean = (sum[i] << GYROBIAS_FRAC_BITS) >> GYROBIAS_WINDOW_SHIFT;
+            window_bias = ((bias[i] >> GYROBIAS_FRAC_BITS)
+                                        << GYROBIAS_FRAC_BITS) + (int) mean;
+
+            // The first window sets the estimate, later ones refine it
+            if ( confidence == 0 )
+            {
+                bias[i] = window_bias;
+            } else {
+                bias[i] += (window_bias - bias[i]) >> GYROBIAS_GAIN_SHIFT;
+            }
+        }
+
+        if ( confidence < 0xFF ) confidence++;
+        age = 0;
+    } else if ( age < 0xFF ) {
+        age++;
+    }
+
+    resetWindow();
+}
+
+static void resetWindow(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        sum[i]    = 0;
+        sum_sq[i] = 0;
+    }
+    count     = 0;
+    is_moving = 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Online gyro bias estimation
+ */
+
+#ifndef __GYROBIAS_H
+#define __GYROBIAS_H
+
+
+#include "layout.h"
+
+// The bias is averaged over windows found to be stationary.
+#define GYROBIAS_FRAC_BITS      GYRO_BIAS_FRAC_BITS
+#define GYROBIAS_WINDOW_SHIFT   (6)     // 64 samples per window
+#define GYROBIAS_VAR_THRESHOLD  (100)   // [counts^2] stationary if below
+#define GYROBIAS_MAX_DEVIATION  (1024)  // [counts] moving if above
+#define GYROBIAS_GAIN_SHIFT     (2)     // weight of a new window, 1/4
+
+
+void gyrobiasSetup(void);
+
+// Feeds a raw gyro sample (x, y, z).
+void gyrobiasUpdate(int *xyz);
+
+// Replaces the estimate, e.g. with the result of an explicit calibration.
+void gyrobiasSeed(int *bias);
+
+// [raw gyro counts] with GYROBIAS_FRAC_BITS fractional bits.
+int* gyrobiasGet(void);
+
+// Stationary windows averaged so far, saturating.
+unsigned char gyrobiasGetConfidence(void);
+
+// Windows seen since the estimate was last updated, saturating.
+unsigned char gyrobiasGetAge(void);
+
+
+#endif // __GYROBIAS_H
@@ -0,0 +1,538 @@
+/*
+ * Record layouts and command IDs shared by the firmware and the host
+ *
+ * Generated by py/layout.py, do not edit by hand: change the schema
+ * there and regenerate this file instead.
+ */
+
+#ifndef __LAYOUT_H
+#define __LAYOUT_H
+
+
+#include <string.h>
+
+
+/* Constants */
+#define ROW_SIZE            152   // [bytes] camera image row
+#define MEM_PAGE_SIZE       528   // [bytes] DataFlash page
+#define MEM_PAGE_DATA_SIZE  526   // [bytes] page data, followed by its CRC
+#define MEM_SECTOR_SIZE     256   // [pages] AT45DB161D sector, erase unit
+#define MEM_PAGE_COUNT      4096  // [pages] AT45DB161D
+#define CATALOG_PAGE        0     // flash page holding the run catalog
+#define CATALOG_MAX_RUNS    12    // runs the catalog can hold
+#define MOTOR_PDC_MAX       1248  // duty cycle register at 100% (2*PTPER)
+#define GYRO_BIAS_FRAC_BITS 4     // fractional bits of gyro_bias
+#define ROW_NONE            0     // row_valid: no row was captured
+#define ROW_STORED          1     // row_valid: its pixels follow
+#define ROW_UNCHANGED       2     // row_valid: as last stored for row_num
+#define PIXEL_LINEAR        0     // pixel_compand: none
+#define PIXEL_GAMMA         1     // pixel_compand: square root
+#define PIXEL_LOG           2     // pixel_compand: logarithm
+#define ATTITUDE_RATE_SCALE 42719 // ITG-3200 count*us to 2^-30 rad/2, Q16
+#define ATTITUDE_OFF        0     // attitude_log: not logged
+#define ATTITUDE_APPENDED   1     // attitude_log: AttitudeRecord after samples
+#define ATTITUDE_IN_GYRO    2     // attitude_log: in place of the gyro rates
+#define READ_SLICES         8     // readback stats timeline, over the pages
+#define RUN_THUMB_SIZE      32    // run summary thumbnail, over the samples
+#define ROW_CORR_DARK       0     // CalibrateRowsArgs phase: lens covered
+#define ROW_CORR_FLAT       1     // CalibrateRowsArgs phase: uniform light
+#define ROW_CORR_GAIN_BITS  12    // fractional bits of row correction gains
+#define ROW_CORR_CHUNK      16    // [columns] per RowCorrChunkRecord
+#define SEQ_MAX_STEPS       24    // steps a sequence can hold
+#define SEQ_ARGS_SIZE       16    // [bytes] of arguments per step
+#define SEQ_WAIT            240   // step cmd: pause, see SeqWaitArgs
+#define SEQ_REPEAT          241   // step cmd: loop back, see SeqRepeatArgs
+#define SEQ_IDLE            0     // SequenceProgressRecord state: not run yet
+#define SEQ_RUNNING         1     // SequenceProgressRecord state: step started
+#define SEQ_DONE            2     // SequenceProgressRecord state: ran to the end
+#define SEQ_STOPPED         3     // SequenceProgressRecord state: by the host
+#define SEQ_FAILED          4     // SequenceProgressRecord state: bad step
+
+/* Commands */
+#define CMD_RESET                 2
+#define CMD_ERASE_MEMORY          3
+#define CMD_RECORD_SENSOR_DUMP    4
+#define CMD_READ_MEMORY           5
+#define CMD_GET_SETTINGS          6
+#define CMD_SET_SAMPLING_PERIOD   7
+#define CMD_SET_MEMORY_PAGE_START 8
+#define CMD_SET_MOTOR_SPEED       9
+#define CMD_CALIBRATE_GYRO        10
+#define CMD_SET_ROW_SCHEDULE      11
+#define CMD_SET_SPEED_CTRL        12
+#define CMD_SET_PROFILE           13
+#define CMD_READ_PAGES            14
+#define CMD_LIST_RUNS             15
+#define CMD_READ_RUN              16
+#define CMD_CLEAR_CATALOG         17
+#define CMD_TIME_SYNC             18
+#define CMD_SET_ROW_GATE          19
+#define CMD_GET_READ_STATS        20
+#define CMD_SET_STEER_CTRL        21
+#define CMD_GET_STEER_STATS       22
+#define CMD_SET_SAMPLE_SKIP       23
+#define CMD_SET_PIXEL_DEPTH       24
+#define CMD_SET_ATTITUDE          25
+#define CMD_GET_RUN_SUMMARY       26
+#define CMD_CALIBRATE_ROWS        27
+#define CMD_SET_ROW_CORR          28
+#define CMD_GET_ROW_CORR          29
+#define CMD_SET_SEQUENCE          30
+#define CMD_RUN_SEQUENCE          31
+
+
+/* Records */
+
+typedef union {
+    struct {
+        unsigned int  id;                   // (2)   sample number, wrapping
+        unsigned long bemf_ts;              // (4)
+        unsigned int  bemf;                 // (2)   main motor Back-EMF
+        unsigned int  motor_pdc;            // (2)   main motor duty cycle register
+        int           motor_err;            // (2)   speed controller error
+        int           steer_pdc;            // (2)   flow steering output
+        unsigned int  steer_latency;        // (2)   [us] row capture to steering PWM
+        unsigned long gyro_ts;              // (4)
+        int           gyro[3];              // (6)   raw gyro values, see attitude_log
+        unsigned long row_ts;               // (4)
+        unsigned char row_num;              // (1)   physical row number
+        unsigned char row_valid;            // (1)   ROW_NONE, _STORED or _UNCHANGED
+    };
+    unsigned char contents[32];
+} SampleRecord;
+
+typedef union {
+    struct {
+        int attitude[3];                    // (6)   Q15 quaternion x, y, z, with w >= 0
+    };
+    unsigned char contents[6];
+} AttitudeRecord;
+
+typedef union {
+    struct {
+        unsigned char row[ROW_SIZE];        // (152) camera image row
+    };
+    unsigned char contents[152];
+} RowRecord;
+
+typedef union {
+    struct {
+        unsigned long sampling_period;      // (4)   [us]
+        float         motor_duty_cycle;     // (4)   [%]
+        unsigned int  mem_page_start;       // (2)
+        unsigned int  speed_setpoint;       // (2)   [ADC counts] target Back-EMF
+        int           speed_kp;             // (2)   Q8.8
+        int           speed_ki;             // (2)   Q8.8
+        unsigned char speed_ctrl;           // (1)   closed-loop motor control?
+        unsigned char steer_ctrl;           // (1)   steering from visual flow?
+        int           gyro_bias[3];         // (6)   [counts] online estimate
+        unsigned char gyro_bias_conf;       // (1)   stationary windows averaged
+        unsigned char gyro_bias_age;        // (1)   windows since last update
+        unsigned int  row_gate;             // (2)   SAD threshold, 0 stores all rows
+        int           steer_kp;             // (2)   steering at full flow imbalance
+        int           steer_kd;             // (2)   ...and at its change over a frame
+        int           steer_derot;          // (2)   yaw rate to flow, see flowsteer.h
+        unsigned int  skip_gyro_full;       // (2)   [counts] |x|+|y|+|z| at full rate
+        unsigned int  skip_bemf_full;       // (2)   [ADC counts] change at full rate
+        unsigned char sample_skip_max;      // (1)   periods between quiet samples
+        unsigned char pixel_depth;          // (1)   [bits] stored per pixel: 8, 6 or 4
+        unsigned char pixel_compand;        // (1)   PIXEL_LINEAR, _GAMMA or _LOG
+        unsigned char pixel_dither;         // (1)   ordered dither when quantising?
+        unsigned int  attitude_period;      // (2)   [us] between gyro reads, 0: off
+        unsigned char attitude_log;         // (1)   ATTITUDE_OFF, _APPENDED or _IN_GYRO
+        unsigned char pad;                  // (1)
+    };
+    unsigned char contents[46];
+} SettingsRecord;
+
+typedef union {
+    struct {
+        unsigned long  start_time;          // (4)   [us]
+        unsigned long  samples;             // (4)   SampleRecords that follow
+        unsigned long  sampling_period;     // (4)   [us]
+        unsigned int   sample_size;         // (2)   [bytes] per SampleRecord
+        unsigned int   row_size;            // (2)   [bytes] per RowRecord
+        int            gyro_bias[3];        // (6)   [counts] at the start of the run
+        unsigned char  gyro_bias_conf;      // (1)
+        unsigned char  gyro_bias_age;       // (1)
+        unsigned char  sample_skip_max;     // (1)   1: every sampling_period
+        unsigned char  pixel_depth;         // (1)   see SettingsRecord
+        unsigned char  pixel_compand;       // (1)
+        unsigned char  pixel_dither;        // (1)
+        unsigned int   attitude_period;     // (2)   [us] 0: attitude not integrated
+        unsigned char  row_corr;            // (1)   rows corrected, see RowCorrInfo
+        unsigned char  attitude_log;        // (1)   see SettingsRecord
+        unsigned char  row_sched_mode;      // (1)   as set by SET_ROW_SCHEDULE
+        unsigned char  row_sched_period;    // (1)
+        unsigned char  row_sched_phase;     // (1)
+        unsigned char  row_sched_pad;       // (1)
+        unsigned char  row_sched_mask[32];  // (32)  1 bit per row_num
+        SettingsRecord settings;            // (46)  as the run started
+    };
+    unsigned char contents[114];
+} RunHeaderRecord;
+
+typedef union {
+    struct {
+        unsigned long timestamp;            // (4)   [s] host clock
+        unsigned long samples;              // (4)
+        unsigned long rows_stored;          // (4)
+        unsigned long rows_unchanged;       // (4)   gated by row_gate
+        unsigned int  start_page;           // (2)
+        unsigned int  pages;                // (2)
+    };
+    unsigned char contents[20];
+} RunEntryRecord;
+
+typedef union {
+    struct {
+        unsigned int   runs;                // (2)
+        RunEntryRecord run[CATALOG_MAX_RUNS]; // (240)
+        unsigned int   crc;                 // (2)   CRC-16-CCITT of the fields above
+    };
+    unsigned char contents[244];
+} CatalogRecord;
+
+typedef union {
+    struct {
+        float offset[3];                    // (12)  gyro offsets
+    };
+    unsigned char contents[12];
+} GyroCalibRecord;
+
+typedef union {
+    struct {
+        unsigned char enabled;              // (1)   applied to rows as they are taken?
+        unsigned char calibrated;           // (1)   bit per ROW_CORR_DARK, _FLAT phase
+        unsigned char rows;                 // (1)   averaged by the last calibration
+        unsigned char phase;                // (1)   ...and its phase
+        unsigned int  level;                // (2)   [pixel values] Q4, mean flat response
+        unsigned int  bench_rows;           // (2)   corrected to time each pass
+        unsigned long bench_time;           // (4)   [us] of the pass used on rows
+        unsigned long bench_time_c;         // (4)   [us] of the portable C pass
+    };
+    unsigned char contents[16];
+} RowCorrInfoRecord;
+
+typedef union {
+    struct {
+        unsigned int first;                 // (2)   column
+        int          offset[ROW_CORR_CHUNK]; // (32)  [pixel values] dark
+        int          gain[ROW_CORR_CHUNK];  // (32)  ROW_CORR_GAIN_BITS fractional
+    };
+    unsigned char contents[66];
+} RowCorrChunkRecord;
+
+typedef union {
+    struct {
+        unsigned long samples;              // (4)
+    };
+    unsigned char contents[4];
+} EraseMemoryArgs;
+
+typedef union {
+    struct {
+        unsigned long timestamp;            // (4)   [s] host clock
+        unsigned long samples;              // (4)
+        unsigned long sample_motor_on;      // (4)
+        unsigned long sample_motor_off;     // (4)
+    };
+    unsigned char contents[16];
+} RecordSensorDumpArgs;
+
+typedef union {
+    struct {
+        unsigned long samples;              // (4)
+        unsigned int  pld_size;             // (2)   [bytes] per packet
+    };
+    unsigned char contents[6];
+} ReadMemoryArgs;
+
+typedef union {
+    struct {
+        unsigned int first;                 // (2)   relative to the run last read
+        unsigned int count;                 // (2)   [pages]
+        unsigned int pld_size;              // (2)   [bytes] per packet
+    };
+    unsigned char contents[6];
+} ReadPagesArgs;
+
+typedef union {
+    struct {
+        unsigned int run;                   // (2)   index in the catalog
+        unsigned int pld_size;              // (2)   [bytes] per packet
+    };
+    unsigned char contents[4];
+} ReadRunArgs;
+
+typedef union {
+    struct {
+        unsigned int seq;                   // (2)   echoed back
+    };
+    unsigned char contents[2];
+} TimeSyncArgs;
+
+typedef union {
+    struct {
+        unsigned long time;                 // (4)   [us] sclock when answered
+        unsigned int  seq;                  // (2)   from TimeSyncArgs
+    };
+    unsigned char contents[6];
+} TimeSyncRecord;
+
+typedef union {
+    struct {
+        unsigned long time;                 // (4)   [us] spent sending pages
+        unsigned long flash_wait;           // (4)   [us] of it waiting on the flash
+        unsigned long radio_wait;           // (4)   [us] of it waiting on the radio
+        unsigned int  pages;                // (2)   sent since the last full read
+        unsigned int  packets;              // (2)
+        unsigned int  request_retries;      // (2)   no free packet to fill
+        unsigned int  enqueue_retries;      // (2)   TX queue full
+        unsigned int  acks_checked;         // (2)   packets whose outcome was seen
+        unsigned int  ack_fails;            // (2)   of them, not acknowledged
+        unsigned long txq_sum;              // (4)   [packets] TX queue after each enqueue
+        unsigned char txq_max;              // (1)   [packets]
+        unsigned char txq_size;             // (1)   [packets] TXPQ_MAX_SIZE
+        unsigned int  pld_size;             // (2)   [bytes] payload of the last read
+    };
+    unsigned char contents[32];
+} ReadStatsRecord;
+
+typedef union {
+    struct {
+        unsigned long time;                 // (4)   [us] spent sending its pages
+        unsigned int  pages;                // (2)
+        unsigned int  packets;              // (2)
+        unsigned int  enqueue_retries;      // (2)
+        unsigned int  ack_fails;            // (2)
+        unsigned long txq_sum;              // (4)   [packets]
+    };
+    unsigned char contents[16];
+} ReadSliceRecord;
+
+typedef union {
+    struct {
+        unsigned long steps;                // (4)   frames steered on, last run
+        unsigned long latency_sum;          // (4)   [us] row capture to steering PWM
+        unsigned long latency_max;          // (4)   [us]
+        unsigned long detect_max;           // (4)   [us] until the frame was complete
+        unsigned long compute_max;          // (4)   [us] from then to the PWM update
+    };
+    unsigned char contents[20];
+} SteerStatsRecord;
+
+typedef union {
+    struct {
+        unsigned long samples;              // (4)   taken, last run
+        unsigned long slots;                // (4)   sampling periods they covered
+        unsigned long rows_none;            // (4)   samples by row_valid
+        unsigned long rows_stored;          // (4)
+        unsigned long rows_unchanged;       // (4)
+        unsigned long late_max;             // (4)   [us] a sample was taken late
+        unsigned int  late;                 // (2)   samples over a sampling period late
+        unsigned int  row_overruns;         // (2)   rows lost to a full camera buffer
+        int           gyro_min[3];          // (6)   [counts]
+        int           gyro_max[3];          // (6)   [counts]
+        int           gyro_mean[3];         // (6)   [counts]
+        unsigned int  gyro_saturated;       // (2)   samples with an axis at full scale
+        unsigned int  bemf_min;             // (2)   [ADC counts]
+        unsigned int  bemf_max;             // (2)   [ADC counts]
+        unsigned int  bemf_mean;            // (2)   [ADC counts]
+        unsigned char thumb[RUN_THUMB_SIZE]; // (32)  mean row intensity, 0: no rows
+    };
+    unsigned char contents[86];
+} RunSummaryRecord;
+
+typedef union {
+    struct {
+        unsigned char cmd;                  // (1)   CMD_* id, SEQ_WAIT or SEQ_REPEAT
+        unsigned char length;               // (1)   [bytes] of args used
+        unsigned char args[SEQ_ARGS_SIZE];  // (16)  as the command takes
+    };
+    unsigned char contents[18];
+} SequenceStepRecord;
+
+typedef union {
+    struct {
+        unsigned char state;                // (1)   SEQ_*
+        unsigned char step;                 // (1)   index of the step started or last
+        unsigned char cmd;                  // (1)   ...and its cmd
+        unsigned char reserved;             // (1)
+        unsigned int  executed;             // (2)   steps started since RUN_SEQUENCE
+        unsigned long time;                 // (4)   [us] sclock at the step start
+    };
+    unsigned char contents[10];
+} SequenceProgressRecord;
+
+typedef union {
+    struct {
+        unsigned long sampling_period;      // (4)   [us]
+    };
+    unsigned char contents[4];
+} SetSamplingPeriodArgs;
+
+typedef union {
+    struct {
+        unsigned int mem_page_start;        // (2)
+    };
+    unsigned char contents[2];
+} SetMemoryPageStartArgs;
+
+typedef union {
+    struct {
+        float motor_duty_cycle;             // (4)   [%]
+    };
+    unsigned char contents[4];
+} SetMotorSpeedArgs;
+
+typedef union {
+    struct {
+        unsigned int row_gate;              // (2)   SAD threshold, 0 stores all rows
+    };
+    unsigned char contents[2];
+} SetRowGateArgs;
+
+typedef union {
+    struct {
+        int           steer_kp;             // (2)   duty cycle register, signed
+        int           steer_kd;             // (2)   duty cycle register, signed
+        int           steer_derot;          // (2)
+        unsigned char steer_ctrl;           // (1)   steering from visual flow?
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[8];
+} SetSteerCtrlArgs;
+
+typedef union {
+    struct {
+        unsigned int  skip_gyro_full;       // (2)   0 leaves the gyro out
+        unsigned int  skip_bemf_full;       // (2)   0 leaves the Back-EMF out
+        unsigned char sample_skip_max;      // (1)   1 samples every period
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[6];
+} SetSampleSkipArgs;
+
+typedef union {
+    struct {
+        unsigned char pixel_depth;          // (1)   [bits] 8, 6 or 4
+        unsigned char pixel_compand;        // (1)   PIXEL_LINEAR, _GAMMA or _LOG
+        unsigned char pixel_dither;         // (1)
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[4];
+} SetPixelDepthArgs;
+
+typedef union {
+    struct {
+        unsigned int  attitude_period;      // (2)   [us] between gyro reads, 0: off
+        unsigned char attitude_log;         // (1)   ATTITUDE_OFF, _APPENDED or _IN_GYRO
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[4];
+} SetAttitudeArgs;
+
+typedef union {
+    struct {
+        unsigned char phase;                // (1)   ROW_CORR_DARK or ROW_CORR_FLAT
+        unsigned char rows;                 // (1)   to average, up to 255
+    };
+    unsigned char contents[2];
+} CalibrateRowsArgs;
+
+typedef union {
+    struct {
+        unsigned char enabled;              // (1)
+        unsigned char pad;                  // (1)
+    };
+    unsigned char contents[2];
+} SetRowCorrArgs;
+
+typedef union {
+    struct {
+        unsigned char mode;                 // (1)   CAMBUFF_SCHED_*
+        unsigned char period;               // (1)
+        unsigned char phase;                // (1)
+        unsigned char row_mask[32];         // (32)  1 bit per row_num
+    };
+    unsigned char contents[35];
+} SetRowScheduleArgs;
+
+typedef union {
+    struct {
+        unsigned int time;                  // (2)   [ms] since the start of playback
+        unsigned int thrust;                // (2)   duty cycle register or Back-EMF
+        int          steer;                 // (2)   signed duty cycle register
+    };
+    unsigned char contents[6];
+} ProfilePointRecord;
+
+typedef union {
+    struct {
+        unsigned char first;                // (1)   index of the first point sent
+        unsigned char count;                // (1)   ProfilePointRecords that follow
+    };
+    unsigned char contents[2];
+} SetProfileArgs;
+
+typedef union {
+    struct {
+        unsigned char length;               // (1)   points held, answering SET_PROFILE
+        unsigned char dropped;              // (1)   points of it out of order or past
+    };
+    unsigned char contents[2];
+} ProfileLengthRecord;
+
+typedef union {
+    struct {
+        unsigned char first;                // (1)   index of the first step sent
+        unsigned char count;                // (1)   SequenceStepRecords that follow
+    };
+    unsigned char contents[2];
+} SetSequenceArgs;
+
+typedef union {
+    struct {
+        unsigned long timestamp;            // (4)   [s] host clock, for recorded runs
+        unsigned char run;                  // (1)   0 stops a running sequence
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[6];
+} RunSequenceArgs;
+
+typedef union {
+    struct {
+        unsigned long time;                 // (4)   [ms]
+    };
+    unsigned char contents[4];
+} SeqWaitArgs;
+
+typedef union {
+    struct {
+        unsigned char first;                // (1)   step to go back to
+        unsigned char count;                // (1)   times to go back
+    };
+    unsigned char contents[2];
+} SeqRepeatArgs;
+
+typedef union {
+    struct {
+        unsigned int  speed_setpoint;       // (2)   [ADC counts] target Back-EMF
+        int           speed_kp;             // (2)   Q8.8
+        int           speed_ki;             // (2)   Q8.8
+        unsigned char speed_ctrl;           // (1)   closed-loop motor control?
+        unsigned char reserved;             // (1)
+    };
+    unsigned char contents[8];
+} SetSpeedCtrlArgs;
+
+
+// Copies a received frame into an argument record (frames are not
+// necessarily aligned). Evaluates to 0 if the frame is too short.
+#define LAYOUT_UNPACK(rec, frame, length)                     \
+    ( ((length) >= sizeof(rec)) ?                             \
+        (memcpy((rec).contents, (frame), sizeof(rec)), 1) : 0 )
+
+
+#endif // __LAYOUT_H
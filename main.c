@@ -45,6 +45,9 @@
 #include "battery.h"
 #include "cmd.h"
 #include "motor_ctrl.h"
+#include "profile.h"
+#include "sequence.h"
+#include "flowsteer.h"
 #include "led.h"
 #include "sclock.h"
 
@@ -52,9 +55,12 @@
 #include "radio_settings.h"
 
 #include "dfmem.h"
+#include "catalog.h"
 #include "cam.h"
 #include "cambuff.h"
+#include "rowcorr.h"
 #include "gyro.h"
+#include "gyrobias.h"
 
 
 int main (void)
@@ -65,7 +71,6 @@ int main (void)
     SetupClock();
     SetupPorts();
     batSetup();
-    cmdSetup();
     mcSetup();
     SetupADC();
     SwitchClocks();
@@ -77,9 +82,15 @@ int main (void)
     radioSetSrcAddr(SRC_ADDR);
 
     dfmemSetup();
+    catalogSetup();
     camSetup();
     cambuffSetup();
+    rowcorrSetup();
     gyroSetup();
+    gyrobiasSetup();
+    profileSetup();
+    sequenceSetup();
+    flowsteerSetup(MOTOR_PDC_MAX);
 
     cmdResetSettings();
 
@@ -96,5 +107,7 @@ int main (void)
     {
         cmdHandleRadioRxBuffer();
         radioProcess();
+        cmdTrackGyroBias();
+        cmdProcessSequence();
     }
 }
@@ -6,6 +6,7 @@
 *********************************************/
 
 #include "motor_ctrl.h"
+#include "speedctrl.h"
 #include "pwm.h"
 #include "ports.h"
 #include "led.h"
@@ -35,14 +36,49 @@ static void mcSetupPeripheral(void);
 void mcSetup(void) {
 
     mcSetupPeripheral();
+    speedctrlSetup(2*pwmPeriod);
 
 }
 
 void mcSetDutyCycle(unsigned char channel, float duty_cycle) {
 
-    unsigned int pdc_value;
-    pdc_value = (unsigned int)(2*duty_cycle/100*pwmPeriod);
-    SetDCMCPWM(channel, pdc_value, 0);
+    mcSetPdc(channel, mcDutyCycleToPdc(duty_cycle));
+
+}
+
+unsigned int mcDutyCycleToPdc(float duty_cycle) {
+
+    return (unsigned int)(2*duty_cycle/100*pwmPeriod);
+
+}
+
+void mcSetPdc(unsigned char channel, unsigned int pdc) {
+
+    SetDCMCPWM(channel, pdc, 0);
+
+}
+
+void mcSpeedCtrlStart(void) {
+
+    speedctrlReset();
+    _AD1IF = 0;
+    _AD1IE = 1;
+
+}
+
+void mcSpeedCtrlStop(void) {
+
+    _AD1IE = 0;
+    PDC1 = 0;
+
+}
+
+// ADC conversions are triggered by the PWM special event, so the back-EMF is
+// always sampled at the same point of the PWM period
+void __attribute__((interrupt, no_auto_psv)) _ADC1Interrupt(void) {
+
+    PDC1 = speedctrlUpdate(ADC1BUF0);
+    _AD1IF = 0;
 
 }
 
@@ -54,15 +90,19 @@ void mcThrust(float value) {
 
 void mcSteer(float value) {
 
-    //char lcdstr[80];
+    mcSteerPdc((int)(2*value/100*pwmPeriod));
+
+}
+
+void mcSteerPdc(int value) {
 
     if (steerMode == MC_STEER_MODE_CONT) {
         if (value > 0) {
-            mcSetDutyCycle(RIGHT_TURN_CHANNEL, 0);
-            mcSetDutyCycle(LEFT_TURN_CHANNEL, value);
+            mcSetPdc(RIGHT_TURN_CHANNEL, 0);
+            mcSetPdc(LEFT_TURN_CHANNEL, value);
         } else if (value < 0) {
-            mcSetDutyCycle(LEFT_TURN_CHANNEL, 0);
-            mcSetDutyCycle(RIGHT_TURN_CHANNEL, -value);
+            mcSetPdc(LEFT_TURN_CHANNEL, 0);
+            mcSetPdc(RIGHT_TURN_CHANNEL, -value);
         } else {
             PDC2 = 0;
             PDC3 = 0;
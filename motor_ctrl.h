@@ -30,12 +30,28 @@ void mcSetup(void);
 // the resolution of the duty cycle is 1/(2*PTPER)
 void mcSetDutyCycle(unsigned char channel, float duty_cycle);
 
+// fixed-point alternatives, taking duty cycle register values (0 to 2*PTPER)
+// so that the float conversion can be done once, away from any time critical
+// code
+unsigned int mcDutyCycleToPdc(float duty_cycle);
+
+void mcSetPdc(unsigned char channel, unsigned int pdc);
+
+// closed-loop speed control of MC_CHANNEL_PWM1 from its back-EMF (see
+// speedctrl.h), run in the ADC interrupt at the PWM rate
+void mcSpeedCtrlStart(void);
+
+void mcSpeedCtrlStop(void);
+
 void mcThrust(float value);
 
 // -100 <= value <= 100 for continuous mode
 // value >0, =0, <0 for discrete mode (default mode)
 void mcSteer(float value);
 
+// same as mcSteer, but taking signed duty cycle register values
+void mcSteerPdc(int value);
+
 // set the motor control mode.
 // the parameters could be either MC_STEER_MODE_DISC or MC_STEER_MODE_CONT
 void mcSetSteerMode(unsigned char mode);
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Lossy pixel quantisation and packing of camera rows
+ */
+
+#include "pixpack.h"
+
+
+// =========== Static Variables ===============================================
+static unsigned char depth   = 8;
+static unsigned char compand = PIXEL_LINEAR;
+static unsigned char dither  = 0;
+
+// Pixel to companded code, as py/layout.py's compand_table() lists them
+static const unsigned char compand_linear[256] =
+{
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,
+     12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,
+     24,  25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,
+     36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,
+     60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     72,  73,  74,  75,  76,  77,  78,  79,  80,  81,  82,  83,
+     84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+     96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107,
+    108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+    120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131,
+    132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155,
+    156, 157, 158, 159, 160, 161, 162, 163, 164, 165, 166, 167,
+    168, 169, 170, 171, 172, 173, 174, 175, 176, 177, 178, 179,
+    180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203,
+    204, 205, 206, 207, 208, 209, 210, 211, 212, 213, 214, 215,
+    216, 217, 218, 219, 220, 221, 222, 223, 224, 225, 226, 227,
+    228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251,
+    252, 253, 254, 255,
+};
+
+// 255 * sqrt(pixel / 255), rounded down
+static const unsigned char compand_gamma[256] =
+{
+      0,  15,  22,  27,  31,  35,  39,  42,  45,  47,  50,  52,
+     55,  57,  59,  61,  63,  65,  67,  69,  71,  73,  74,  76,
+     78,  79,  81,  82,  84,  85,  87,  88,  90,  91,  93,  94,
+     95,  97,  98,  99, 100, 102, 103, 104, 105, 107, 108, 109,
+    110, 111, 112, 114, 115, 116, 117, 118, 119, 120, 121, 122,
+    123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134,
+    135, 136, 137, 138, 139, 140, 141, 141, 142, 143, 144, 145,
+    146, 147, 148, 148, 149, 150, 151, 152, 153, 153, 154, 155,
+    156, 157, 158, 158, 159, 160, 161, 162, 162, 163, 164, 165,
+    165, 166, 167, 168, 168, 169, 170, 171, 171, 172, 173, 174,
+    174, 175, 176, 177, 177, 178, 179, 179, 180, 181, 182, 182,
+    183, 184, 184, 185, 186, 186, 187, 188, 188, 189, 190, 190,
+    191, 192, 192, 193, 194, 194, 195, 196, 196, 197, 198, 198,
+    199, 200, 200, 201, 201, 202, 203, 203, 204, 205, 205, 206,
+    206, 207, 208, 208, 209, 210, 210, 211, 211, 212, 213, 213,
+    214, 214, 215, 216, 216, 217, 217, 218, 218, 219, 220, 220,
+    221, 221, 222, 222, 223, 224, 224, 225, 225, 226, 226, 227,
+    228, 228, 229, 229, 230, 230, 231, 231, 232, 233, 233, 234,
+    234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 240, 240,
+    241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246,
+    247, 247, 248, 248, 249, 249, 250, 250, 251, 251, 252, 252,
+    253, 253, 254, 255,
+};
+
+// 255 * log2(pixel + 1) / 8, with log2 interpolated linearly between
+// powers of 2
+static const unsigned char compand_log[256] =
+{
+      0,  31,  47,  63,  71,  79,  87,  95,  99, 103, 107, 111,
+    115, 119, 123, 127, 129, 131, 133, 135, 137, 139, 141, 143,
+    145, 147, 149, 151, 153, 155, 157, 159, 160, 161, 162, 163,
+    164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187,
+    188, 189, 190, 191, 191, 192, 192, 193, 193, 194, 194, 195,
+    195, 196, 196, 197, 197, 198, 198, 199, 199, 200, 200, 201,
+    201, 202, 202, 203, 203, 204, 204, 205, 205, 206, 206, 207,
+    207, 208, 208, 209, 209, 210, 210, 211, 211, 212, 212, 213,
+    213, 214, 214, 215, 215, 216, 216, 217, 217, 218, 218, 219,
+    219, 220, 220, 221, 221, 222, 222, 223, 223, 223, 223, 224,
+    224, 224, 224, 225, 225, 225, 225, 226, 226, 226, 226, 227,
+    227, 227, 227, 228, 228, 228, 228, 229, 229, 229, 229, 230,
+    230, 230, 230, 231, 231, 231, 231, 232, 232, 232, 232, 233,
+    233, 233, 233, 234, 234, 234, 234, 235, 235, 235, 235, 236,
+    236, 236, 236, 237, 237, 237, 237, 238, 238, 238, 238, 239,
+    239, 239, 239, 240, 240, 240, 240, 241, 241, 241, 241, 242,
+    242, 242, 242, 243, 243, 243, 243, 244, 244, 244, 244, 245,
+    245, 245, 245, 246, 246, 246, 246, 247, 247, 247, 247, 248,
+    248, 248, 248, 249, 249, 249, 249, 250, 250, 250, 250, 251,
+    251, 251, 251, 252, 252, 252, 252, 253, 253, 253, 253, 254,
+    254, 254, 254, 255,
+};
+
+static const unsigned char bayer[PIXPACK_DITHER_SIZE * PIXPACK_DITHER_SIZE] =
+{
+     0,  8,  2, 10,
+    12,  4, 14,  6,
+     3, 11,  1,  9,
+    15,  7, 13,  5,
+};
+
+// Companding table in use, and what to add to codes before dropping bits:
+// 4x4 Bayer thresholds scaled to a step when dithering, else half a step
+static const unsigned char *table = compand_linear;
+static unsigned char threshold[PIXPACK_DITHER_SIZE * PIXPACK_DITHER_SIZE];
+
+// =========== Function Stubs =================================================
+static unsigned char quantise(unsigned char code, unsigned char offset);
+
+// =========== Public Functions ===============================================
+
+void pixpackSetup(unsigned char new_depth, unsigned char new_compand,
+                  unsigned char new_dither)
+{
+    unsigned int  i;
+    unsigned char shift;
+
+    depth   = (new_depth == 6 || new_depth == 4) ? new_depth : 8;
+    compand = (new_compand <= PIXEL_LOG) ? new_compand : PIXEL_LINEAR;
+    dither  = (new_dither && depth < 8);
+
+    switch ( compand )
+    {
+        case PIXEL_GAMMA:   table = compand_gamma;  break;
+        case PIXEL_LOG:     table = compand_log;    break;
+        default:            table = compand_linear; break;
+    }
+
+    shift = 8 - depth;
+    for ( i = 0; i < PIXPACK_DITHER_SIZE * PIXPACK_DITHER_SIZE; i++ )
+    {
+        threshold[i] = dither ? bayer[i] >> (4 - shift) : (1 << shift) >> 1;
+    }
+}
+
+unsigned char pixpackIsRaw(void)
+{
+    return (depth == 8 && compand == PIXEL_LINEAR);
+}
+
+unsigned char pixpackRowSize(void)
+{
+    return (ROW_SIZE / 8) * depth;
+}
+
+void pixpackRow(unsigned char row_num, unsigned char *pixels)
+{
+    unsigned char *out = pixels;
+    unsigned char *t   = &threshold[(row_num % PIXPACK_DITHER_SIZE)
+                                                * PIXPACK_DITHER_SIZE];
+    unsigned char  i, c0, c1, c2, c3;
+
+    // Writes never overtake reads, as packed rows are no longer. Rows start
+    // on a multiple of the dither matrix size, as steps are.
+    switch ( depth )
+    {
+        case 4:
+            for ( i = 0; i < ROW_SIZE; i += 4 )
+            {
+                c0 = quantise(table[pixels[i]],     t[0]);
+                c1 = quantise(table[pixels[i + 1]], t[1]);
+                c2 = quantise(table[pixels[i + 2]], t[2]);
+                c3 = quantise(table[pixels[i + 3]], t[3]);
+                *out++ = c0 | (c1 << 4);
+                *out++ = c2 | (c3 << 4);
+            }
+            break;
+
+        case 6:
+            for ( i = 0; i < ROW_SIZE; i += 4 )
+            {
+                c0 = quantise(table[pixels[i]],     t[0]);
+                c1 = quantise(table[pixels[i + 1]], t[1]);
+                c2 = quantise(table[pixels[i + 2]], t[2]);
+                c3 = quantise(table[pixels[i + 3]], t[3]);
+                *out++ = c0        | (c1 << 6);
+                *out++ = (c1 >> 2) | (c2 << 4);
+                *out++ = (c2 >> 4) | (c3 << 2);
+            }
+            break;
+
+        default:
+            for ( i = 0; i < ROW_SIZE; i++ ) pixels[i] = table[pixels[i]];
+            break;
+    }
+}
+
+
+// =========== Private Functions ==============================================
+
+static unsigned char quantise(unsigned char code, unsigned char offset)
+{
+    unsigned int value = ((unsigned int) code + offset) >> (8 - depth);
+
+    // Rounding up may overflow the codes kept
+    return (value >> depth) ? (1 << depth) - 1 : (unsigned char) value;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Lossy pixel quantisation and packing of camera rows
+ */
+
+#ifndef __PIXPACK_H
+#define __PIXPACK_H
+
+
+#include "layout.h"
+
+// Unpacked on the host by py/layout.py.
+#define PIXPACK_DITHER_SIZE     (4)     // [pixels] side of the dither matrix
+
+
+// Depths other than 8, 6 or 4 bits fall back to 8. Compand is one of
+// PIXEL_LINEAR, PIXEL_GAMMA or PIXEL_LOG.
+void pixpackSetup(unsigned char depth, unsigned char compand,
+                  unsigned char dither);
+
+// Returns 1 if rows are stored as captured, with nothing to pack.
+unsigned char pixpackIsRaw(void);
+
+// [bytes] of a packed row.
+unsigned char pixpackRowSize(void);
+
+// Packs a row in place, into its first pixpackRowSize() bytes.
+void pixpackRow(unsigned char row_num, unsigned char *pixels);
+
+
+#endif // __PIXPACK_H
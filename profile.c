@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Motor profile playback
+ */
+
+#include "profile.h"
+#include "motor_ctrl.h"
+#include "speedctrl.h"
+#include "sclock.h"
+#include "p33Fxxxx.h"
+
+#define PROFILE_TIMER_PERIOD    (624) // 1KHz at MIPS == 40, 1:64 prescale
+
+
+// =========== Static Variables ===============================================
+static ProfilePointStruct points[PROFILE_MAX_POINTS];
+static unsigned int length;
+
+static volatile unsigned char is_running = 0;
+static volatile unsigned char is_holding = 0;   // on the last point
+static unsigned char use_speed_ctrl;
+static unsigned char use_steer;
+static unsigned int segment;            // current point
+static unsigned long start_time;        // [us]
+
+// =========== Function Stubs =================================================
+static int interpolate(int v0, int v1, unsigned int t0, unsigned int t1,
+                       unsigned int t);
+static void applySetpoints(unsigned int thrust, int steer);
+
+// =========== Public Functions ===============================================
+
+void profileSetup(void)
+{
+    T4CON = 0;
+    T4CONbits.TCKPS = 0b10;     // 1:64 prescale
+    PR4  = PROFILE_TIMER_PERIOD;
+    TMR4 = 0;
+    _T4IP = 4;
+    _T4IF = 0;
+    _T4IE = 0;
+
+    profileClear();
+}
+
+void profileClear(void)
+{
+    profileStop();
+    length = 0;
+}
+
+unsigned char profileSetPoint(unsigned int index, ProfilePoint point)
+{
+    if ( index >= PROFILE_MAX_POINTS || index > length ) return 0;
+
+    // Interpolation runs forward in time, from one point to the next
+    if ( index > 0 && point->time <= points[index - 1].time ) return 0;
+    if ( index + 1 < length && point->time >= points[index + 1].time )
+        return 0;
+
+    points[index] = *point;
+    if ( index == length ) length++;
+    return 1;
+}
+
+unsigned int profileGetLength(void)
+{
+    return length;
+}
+
+void profileStart(unsigned char speed_ctrl, unsigned char steer)
+{
+    if ( length == 0 ) return;
+
+    use_speed_ctrl = speed_ctrl;
+    use_steer      = steer;
+    segment        = 0;
+    start_time     = sclockGetTime();
+    is_running     = 1;
+    is_holding     = 0;
+
+    if ( use_speed_ctrl ) mcSpeedCtrlStart();
+
+    TMR4 = 0;
+    _T4IF = 0;
+    _T4IE = 1;
+    T4CONbits.TON = 1;
+}
+
+void profileStop(void)
+{
+    T4CONbits.TON = 0;
+    _T4IE = 0;
+
+    if ( is_running || is_holding )
+    {
+        mcSpeedCtrlStop();
+        mcSetPdc(MC_CHANNEL_PWM1, 0);
+        mcSteerPdc(0);
+    }
+
+    is_running = 0;
+    is_holding = 0;
+}
+
+unsigned char profileIsRunning(void)
+{
+    return is_running;
+}
+
+unsigned char profileIsHolding(void)
+{
+    return is_holding;
+}
+
+// =========== Private Functions ==============================================
+void __attribute__((interrupt, no_auto_psv)) _T4Interrupt(void)
+{
+    unsigned long elapsed = (sclockGetTime() - start_time) / 1000;
+    unsigned int  t;
+    ProfilePoint  p0, p1;
+
+    _T4IF = 0;
+
+    // Hold the last point once the end of the table is reached
+    if ( elapsed >= points[length - 1].time )
+    {
+        applySetpoints(points[length - 1].thrust, points[length - 1].steer);
+        T4CONbits.TON = 0;
+        _T4IE = 0;
+        is_holding = 1;
+        is_running = 0;
+        return;
+    }
+
+    t = (unsigned int) elapsed;
+    while ( segment < length - 1 && points[segment + 1].time <= t ) segment++;
+
+    p0 = &points[segment];
+    p1 = &points[segment + 1];
+
+    if ( t < p0->time )
+    {
+        applySetpoints(p0->thrust, p0->steer);  // before the first point
+    } else {
+        applySetpoints(
+            (unsigned int) interpolate(p0->thrust, p1->thrust,
+                                       p0->time, p1->time, t),
+            interpolate(p0->steer, p1->steer, p0->time, p1->time, t));
+    }
+}
+
+static int interpolate(int v0, int v1, unsigned int t0, unsigned int t1,
+                       unsigned int t)
+{
+    if ( t1 <= t0 ) return v1;
+    return v0 + (int)(((long)(v1 - v0) * (long)(t - t0)) / (long)(t1 - t0));
+}
+
+static void applySetpoints(unsigned int thrust, int steer)
+{
+    if ( use_speed_ctrl )
+    {
+        speedctrlSetSetpoint(thrust);
+    } else {
+        mcSetPdc(MC_CHANNEL_PWM1, thrust);
+    }
+
+    if ( use_steer ) mcSteerPdc(steer);
+}
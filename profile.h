@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Motor profile playback
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+
+// A profile is a table of thrust and steering setpoints over time, played
+// back with linear interpolation from a 1KHz timer interrupt, independently
+// of whatever else runs in the main loop.
+//
+// Thrust is a MC_CHANNEL_PWM1 duty cycle register value or, if the speed
+// controller is in use, a back-EMF setpoint. Steering is a signed duty cycle
+// register value, as taken by mcSteerPdc.
+
+#define PROFILE_MAX_POINTS  (32)
+
+typedef struct {
+    unsigned int time;      // [ms] since the start of playback
+    unsigned int thrust;
+    int          steer;
+} ProfilePointStruct;
+
+typedef ProfilePointStruct* ProfilePoint;
+
+
+void profileSetup(void);
+
+// Empties the profile table.
+void profileClear(void);
+
+// Sets a point of the table, which must be filled in order of index and of
+// time. Returns 0, leaving the table as it was, for a point out of order.
+unsigned char profileSetPoint(unsigned int index, ProfilePoint point);
+
+unsigned int profileGetLength(void);
+
+// Starts playback from time zero. With speed_ctrl set, thrust drives the
+// speed controller's setpoint instead of the duty cycle. With steer cleared,
+// steering setpoints are ignored, leaving steering to e.g. flowsteer.
+void profileStart(unsigned char speed_ctrl, unsigned char steer);
+
+// Stops playback, or the hold of the last point, turning the motors off.
+void profileStop(void);
+
+// Playback is running until the last point is reached, which is then held
+// until profileStop.
+unsigned char profileIsRunning(void);
+unsigned char profileIsHolding(void);
+
+
+#endif // __PROFILE_H
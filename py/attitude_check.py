@@ -0,0 +1,201 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Check the on-board attitude integrator against floating point
+#
+# Builds attitude.c through firmsim and feeds it synthetic gyro counts, read
+# at the gyro's rate with some timing jitter, for a flapping robot: fast roll
+# and pitch oscillations over a slow turn. The same counts are integrated in
+# floating point, with exact rotations, and the angle between both attitudes
+# is reported over time. Integrating once per stored sample instead, as done
+# offline so far, is shown for comparison. Fails if the mean angle exceeds
+# --tol.
+#
+# With a session, the attitudes logged in its samples are compared with
+# floating point integration of its stored gyro samples instead.
+#
+#   python attitude_check.py --t 10 --flap 20
+#   python attitude_check.py data/latest_session.shelf
+#
+
+import shelve, ctypes, argparse
+import numpy as np
+import firmsim, layout
+
+
+# [rad/s] per gyro count, matching ATTITUDE_RATE_SCALE
+RATE = layout.const.ATTITUDE_RATE_SCALE * 2. / 2**16 / 2**30 * 1E6
+
+
+class Integrator(object):
+    '''attitude.c, returning vector parts as logged in samples.'''
+
+    def __init__(self):
+        self.lib = firmsim.load('attitude')
+        self.lib.attitudeReset()
+        self.bias = (ctypes.c_int16 * 3)(0, 0, 0)
+
+    def update(self, gyro, ts):
+        self.lib.attitudeUpdate((ctypes.c_int16 * 3)(*[int(g) for g in gyro]),
+                                self.bias, int(ts))
+
+    def vector(self):
+        xyz = (ctypes.c_int16 * 3)()
+        self.lib.attitudeGetVector(xyz)
+        return xyz[:]
+
+
+def multiply(a, b):
+    w1, x1, y1, z1 = a
+    w2, x2, y2, z2 = b
+    return np.array([w1*w2 - x1*x2 - y1*y2 - z1*z2,
+                     w1*x2 + x1*w2 + y1*z2 - z1*y2,
+                     w1*y2 - x1*z2 + y1*w2 + z1*x2,
+                     w1*z2 + x1*y2 - y1*x2 + z1*w2])
+
+def integrate(rates, ts):
+    '''Attitudes from rates [rad/s] at times ts [us], rotating exactly by the
+    trapezoidal mean of consecutive rates, as attitude.c does to first
+    order.'''
+    q, out = np.array([1., 0., 0., 0.]), [np.array([1., 0., 0., 0.])]
+    for i in range(1, len(ts)):
+        angle = (rates[i - 1] + rates[i]) / 2 * (ts[i] - ts[i - 1]) * 1E-6
+        norm  = np.linalg.norm(angle)
+        if norm > 0:
+            q = multiply(q, np.r_[np.cos(norm / 2), \
+                                  np.sin(norm / 2) * angle / norm])
+        out.append(q)
+    return np.array(out)
+
+def angle(q1, q2):
+    '''[deg] between attitudes, whatever the sign of the quaternions.'''
+    dot = np.abs(np.sum(q1 * q2, axis=1)) / \
+            (np.linalg.norm(q1, axis=1) * np.linalg.norm(q2, axis=1))
+    return np.degrees(2 * np.arccos(np.minimum(1, dot)))
+
+
+def synthetic(a):
+    rng  = np.random.RandomState(a.seed)
+    n    = int(a.t * 1E6 / a.gyro_period)
+    ts   = np.cumsum(a.gyro_period + rng.randint(-a.jitter, a.jitter + 1, n))
+    t    = ts * 1E-6
+    flap = 2 * np.pi * a.flap
+    rates = np.column_stack((
+        a.amplitude * np.sin(flap * t),
+        .5 * a.amplitude * np.cos(flap * t + .3),
+        a.turn + .1 * a.amplitude * np.sin(flap * t / 7)))
+    counts = np.round(rates / RATE + rng.normal(0, a.noise, rates.shape))
+    counts = np.clip(counts, -32768, 32767).astype(int)
+
+    ctrl = Integrator()
+    fixed = np.zeros(n, dtype=[('attitude', 'i2', 3)])
+    for i in range(n):
+        ctrl.update(counts[i], ts[i])
+        fixed['attitude'][i] = ctrl.vector()
+    fixed = layout.attitude_quat(fixed)
+    exact = integrate(counts * RATE, ts)
+
+    # Every k-th gyro read, as if only stored samples were integrated
+    k      = max(1, int(round(a.sampling_period / a.gyro_period)))
+    sparse = integrate(counts[::k] * RATE, ts[::k])
+
+    err   = angle(fixed, exact)
+    alias = angle(sparse, exact[::k])
+    print('I: %d gyro reads over %.1f s, attitude %.1f deg from start ' \
+          'at the end' % (n, a.t, angle(exact[-1:], exact[:1])[0]))
+    print('I: Fixed point against float: %.4f deg mean, %.4f deg max, ' \
+          '%.4f deg at the end' % (err.mean(), err.max(), err[-1]))
+    print('I: Integrating every %d reads instead: %.3f deg mean, ' \
+          '%.3f deg max' % (k, alias.mean(), alias.max()))
+    checks = firmsim.Checks()
+    checks.check('Fixed point mean error [deg]', err.mean(), a.tol)
+    checks.exit()
+
+
+def replay(a):
+    shelf = shelve.open(a.session, 'r')
+    d     = shelf['d']
+    shelf.close()
+
+    r     = d.runs[a.run] if a.run is not None else d
+    count = r.sample_cnt
+    if not count or not r.header['attitude_log']:
+        print('W: Attitude was not logged on board for this run')
+        return
+    if r.header['attitude_log'] == layout.const.ATTITUDE_IN_GYRO:
+        print('W: Attitude was logged in place of the gyro rates, which ' \
+              'are not there to compare it with')
+        return
+    sample = r.sample[:count]
+    bias   = np.float64(r.header['gyro_bias']) / \
+                                    2**layout.const.GYRO_BIAS_FRAC_BITS
+    ts     = (sample['gyro_ts'].astype(np.int64) - \
+                                    int(sample['gyro_ts'][0])) % 2**32
+    exact  = integrate((sample['gyro'] - bias) * RATE, ts)
+    logged = layout.attitude_quat(sample)
+    err    = angle(logged, exact)
+    print('I: %d samples, gyro read every %d us on board' % \
+                                    (count, r.header['attitude_period']))
+    print('I: Logged against float integration of the stored samples: ' \
+          '%.3f deg mean, %.3f deg max' % (err.mean(), err.max()))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('session', nargs='?',
+                        help='shelf saved by sensor_dump.py')
+    parser.add_argument('--run',         type=int,   default=None,
+                        help='run read back from the catalog, not the latest')
+    parser.add_argument('--t',           type=float, default=10., help='[s]')
+    parser.add_argument('--gyro-period', type=int,   default=1000,
+                        help='[us] between gyro reads')
+    parser.add_argument('--sampling-period', type=int, default=4000,
+                        help='[us] between stored samples')
+    parser.add_argument('--jitter',      type=int,   default=50, help='[us]')
+    parser.add_argument('--flap',        type=float, default=20., help='[Hz]')
+    parser.add_argument('--amplitude',   type=float, default=8.,
+                        help='[rad/s] of the roll oscillation')
+    parser.add_argument('--turn',        type=float, default=.5,
+                        help='[rad/s] of yaw')
+    parser.add_argument('--noise',       type=float, default=2.,
+                        help='[counts]')
+    parser.add_argument('--seed',        type=int,   default=1)
+    parser.add_argument('--tol',         type=float, default=.1,
+                        help='[deg] mean fixed point error, synthetic only')
+    a = parser.parse_args()
+
+    if a.session:
+        replay(a)
+    else:
+        synthetic(a)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Clock synchronization between the board's sclock and the host
+#
+# A background thread periodically sends CMD_TIME_SYNC, which the board
+# answers with its sclock time. Each exchange pairs that time with the host
+# time halfway through the round trip. Exchanges that took much longer than
+# the quickest one are dropped, as the board was busy or the link queued,
+# and a line fit through the rest gives the offset and drift of the board
+# clock, i.e. host_time = offset + rate * board_time.
+#
+# The fit is a plain dict, so sessions can be shelved with it and later
+# mapped with to_host().
+#
+
+import threading, time
+import numpy as np
+import layout
+from layout import CMD
+
+
+RTT_FACTOR = 1.5    # exchanges slower than this times the quickest...
+RTT_SLACK  = .002   # [s] ...plus this are dropped
+SENT_AGE   = 5      # [periods] after which an answer is taken as lost
+
+SCLOCK_WRAP = 2**32 # [us] sclock is an unsigned long
+
+
+class ClockSync(object):
+
+    def __init__(self, wrl, dest_addr, period=.2):
+        self.wrl       = wrl
+        self.dest_addr = dest_addr
+        self.period    = period     # [s] between exchanges
+        self.seq       = 0
+        self.sent      = {}         # host send time, by seq, unanswered
+        self.exchanges = []         # (host time, board time, rtt) [s, us, s]
+        self.lock      = threading.Lock()
+        self.active    = threading.Event()
+        self.running   = False
+        self.thread    = None
+
+    def start(self):
+        self.running = True
+        self.active.set()
+        self.thread = threading.Thread(target=self.run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def pause(self):
+        '''Stops exchanges, e.g. while the board is too busy to answer.
+        Those in flight are given up, as their answers would be late.'''
+        self.active.clear()
+        with self.lock:
+            self.sent.clear()
+
+    def resume(self):
+        self.active.set()
+
+    def stop(self):
+        self.running = False
+        self.active.set()
+        self.thread.join()
+
+    def run(self):
+        while self.running:
+            self.active.wait()
+            if not self.running:
+                break
+            with self.lock:
+                # Forget lost answers, before seq wraps around to them
+                now = time.time()
+                for old in [k for k, t in self.sent.items() \
+                                    if now - t > SENT_AGE * self.period]:
+                    del self.sent[old]
+                seq, self.seq = self.seq, (self.seq + 1) % 2**16
+                self.sent[seq] = now
+            self.wrl.send(self.dest_addr, 0, CMD.TIME_SYNC, \
+                                        layout.pack('TimeSyncArgs', seq))
+            time.sleep(self.period)
+
+    def received(self, data, t_recv=None):
+        '''Handles a CMD_TIME_SYNC answer, received at host time t_recv.'''
+        t_recv = time.time() if t_recv is None else t_recv
+        record = layout.unpack('TimeSyncRecord', data)
+        with self.lock:
+            t_sent = self.sent.pop(int(record['seq']), None)
+            if t_sent is not None:
+                self.exchanges.append(((t_sent + t_recv) / 2., \
+                                        int(record['time']), t_recv - t_sent))
+
+    def fit(self):
+        '''Offset [s] and rate of the board clock, or None without data.'''
+        with self.lock:
+            exchanges = sorted(self.exchanges)
+        if not exchanges:
+            return None
+
+        host, board, rtt = [np.array(x, dtype=float) \
+                                            for x in zip(*exchanges)]
+
+        # Undo sclock wraparounds, as exchanges are in host time order
+        wraps = np.cumsum(np.r_[0, np.diff(board) < -SCLOCK_WRAP / 2])
+        board = (board + wraps * SCLOCK_WRAP) * 1E-6
+
+        keep = rtt <= RTT_FACTOR * rtt.min() + RTT_SLACK
+        host, board = host[keep], board[keep]
+
+        if keep.sum() > 1 and np.ptp(board) > 0:
+            rate, offset = np.polyfit(board, host, 1)
+        else:
+            rate, offset = 1., np.mean(host - board)
+
+        return dict(
+            offset    = float(offset),      # [s] host time at board time 0
+            rate      = float(rate),        # host seconds per board second
+            drift     = (rate - 1.) * 1E6,  # [ppm] < 0 if the board runs fast
+            rtt_min   = float(rtt.min()),   # [s]
+            exchanges = len(exchanges),
+            used      = int(keep.sum()),
+            wraps     = int(wraps[-1]),
+        )
+
+
+def to_host(fit, board_time):
+    '''Maps board sclock times [us] to host times [s], given a fit.
+
+    Times are unwrapped assuming they are in order and that the first one
+    falls within the same sclock wraparound as the first exchange. NaN marks
+    missing times, which are left out of the unwrapping and stay NaN.'''
+    board = np.array(board_time, dtype=float)
+    if board.ndim and board.size:
+        valid = ~np.isnan(board)
+        times = board[valid]
+        board[valid] = times + SCLOCK_WRAP * \
+                        np.cumsum(np.r_[0, np.diff(times) < -SCLOCK_WRAP / 2])
+    return fit['offset'] + fit['rate'] * board * 1E-6
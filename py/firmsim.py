@@ -0,0 +1,157 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Host-side builds of the portable firmware modules
+#
+# Modules without hardware dependencies (e.g. speedctrl.c) are compiled into
+# a shared library with the host's C compiler and loaded through ctypes, so
+# that the exact firmware arithmetic can be exercised on Linux.
+#
+# Sources and headers are built from copies with XC16's type widths spelled
+# out (int is 16 bits, long 32), so stored values, record layouts and ctypes
+# arguments wrap as they do on board. Arithmetic on ints still happens in the
+# host's 32-bit int after promotion, so an int expression that overflows
+# only before it is stored is not caught.
+#
+# Scripts built on this check their results with Checks, which fails the
+# process when a tolerance is exceeded.
+#
+
+import os, sys, re, glob, subprocess, tempfile, ctypes
+
+
+FIRMWARE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+BUILD_DIR    = os.path.join(tempfile.gettempdir(), 'unsteady_of_firmsim')
+
+# XC16 types, longest match first
+WIDTHS = [
+    (r'\bunsigned long long\b', 'uint64_t'),
+    (r'\blong long\b',          'int64_t'),
+    (r'\bunsigned long\b',      'uint32_t'),
+    (r'\bunsigned int\b',       'uint16_t'),
+    (r'\blong\b',               'int32_t'),
+    (r'\bint\b',                'int16_t'),
+]
+
+CTYPES = {
+    'void':          None,
+    'unsigned char': ctypes.c_ubyte,
+    'char':          ctypes.c_char,
+    'int16_t':       ctypes.c_int16,
+    'uint16_t':      ctypes.c_uint16,
+    'int32_t':       ctypes.c_int32,
+    'uint32_t':      ctypes.c_uint32,
+    'int64_t':       ctypes.c_int64,
+    'uint64_t':      ctypes.c_uint64,
+    'float':         ctypes.c_float,
+}
+
+PROTOTYPE = re.compile(r'^\s*([A-Za-z_][\w ]*?[\w*]+)\s*\b(\w+)\s*' \
+                       r'\(([^;{}()]*)\)\s*;', re.M)
+
+
+def xc16(text):
+    '''C source with the XC16 widths of its integer types.'''
+    for pattern, width in WIDTHS:
+        text = re.sub(pattern, width, text)
+    return '#include <stdint.h>\n' + text
+
+
+def load(*modules):
+    '''Builds the given firmware modules (e.g. 'speedctrl') and loads them,
+    with argument and return types from their headers.'''
+    src = os.path.join(BUILD_DIR, '_'.join(modules))
+    if not os.path.isdir(src):
+        os.makedirs(src)
+    sources = [os.path.join(FIRMWARE_DIR, m + '.c') for m in modules]
+    headers = glob.glob(os.path.join(FIRMWARE_DIR, '*.h'))
+    lib     = os.path.join(src, 'firmsim.so')
+    if not os.path.exists(lib) or os.path.getmtime(lib) < \
+            max(os.path.getmtime(f) for f in sources + headers + [__file__]):
+        for path in sources + headers:
+            with open(path) as f:
+                text = xc16(f.read())
+            with open(os.path.join(src, os.path.basename(path)), 'w') as f:
+                f.write(text)
+        subprocess.check_call([os.environ.get('CC', 'cc'), '-O2', '-shared',
+                    '-fPIC', '-I' + src, '-o', lib] + [os.path.join(src, \
+                                    os.path.basename(s)) for s in sources])
+
+    dll = ctypes.CDLL(lib)
+    for module in modules:
+        header = os.path.join(src, module + '.h')
+        if os.path.exists(header):
+            with open(header) as f:
+                declare(dll, f.read())
+    return dll
+
+
+def declare(dll, header):
+    '''Sets the ctypes types of the functions prototyped in a header.'''
+    header = re.sub(r'/\*.*?\*/', '', re.sub(r'//.*', '', header), flags=re.S)
+    for ret, name, params in PROTOTYPE.findall(header):
+        if not hasattr(dll, name):
+            continue
+        types = [ctype(p.strip()) for p in params.split(',') \
+                                    if p.strip() and p.strip() != 'void']
+        func  = getattr(dll, name)
+        ret   = ctype(ret.strip() + ' ' + name)
+        if ret is not False:
+            func.restype = ret
+        if all(t is not False for t in types):
+            func.argtypes = types
+
+
+def ctype(param):
+    '''ctypes type of a declared parameter, False if unknown.'''
+    if '*' in param:
+        return ctypes.c_void_p
+    base = ' '.join(param.split()[:-1])
+    return CTYPES.get(base, False)
+
+
+class Checks(object):
+    '''Results checked against tolerances, so that a script fails the
+    process when one is out of bounds.'''
+
+    def __init__(self):
+        self.failed = 0
+
+    def check(self, what, value, tolerance):
+        ok = value <= tolerance
+        print('%s: %s %g, tolerance %g' % ('I' if ok else 'E', what, \
+                                                        value, tolerance))
+        self.failed += not ok
+        return ok
+
+    def exit(self):
+        if self.failed:
+            print('E: %d checks failed' % self.failed)
+        sys.exit(1 if self.failed else 0)
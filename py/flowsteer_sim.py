@@ -0,0 +1,309 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Replay camera rows through the on-board flow steering controller
+#
+# Builds flowsteer.c through firmsim and feeds it the rows of a recorded
+# session, as the recorder does, reporting the flow, imbalance and steering
+# output of every frame. When the run was steered on board, outputs are
+# compared with those logged in its samples, along with the latency from row
+# capture to PWM update logged for each step.
+#
+# Without a session, a corridor is synthesized instead: a robot driving
+# between two textured walls, steered by the controller in closed loop,
+# which should bring it back to the centre. Its yaw rate is fed in as gyro
+# counts of 1 mrad/s, once per 1 ms sample, for derotation.
+#
+# Frames end on the rows the board closed them on, as told by the row
+# schedule in the run header. Fails if replayed outputs differ from those on
+# board or, when the rows were stored lossy (pixel_depth below 8, or gated),
+# if they differ by more than --pdc-tol on average. Fails too if the robot
+# ends further than --tol from the centre of the corridor.
+#
+#   python flowsteer_sim.py data/latest_session.shelf
+#   python flowsteer_sim.py --offset .1 --kp -200 --kd -1000
+#
+
+import sys, time, shelve, ctypes, argparse
+import numpy as np
+import firmsim, layout
+
+
+ROW_SIZE = layout.const.ROW_SIZE
+ROWS     = 160      # camera rows per frame
+FPS      = 25.      # [frames/s]
+SAMPLES  = 40       # per frame, at the 1 ms sampling period
+BIN_SIZE = 4        # pixels per profile bin, see FLOWSTEER_BIN_SHIFT
+
+SCHED_EVERY_KTH, SCHED_ROW_SET, SCHED_ROUND_ROBIN = 1, 2, 3 # see cambuff.h
+
+
+class Controller(object):
+    '''flowsteer.c, fed with the rows of numpy arrays.'''
+
+    def __init__(self, kp, kd, derot):
+        self.lib = firmsim.load('flowsteer')
+        self.lib.flowsteerSetup(layout.const.MOTOR_PDC_MAX)
+        self.lib.flowsteerSetGains(kp, kd)
+        self.lib.flowsteerSetDerotation(derot)
+        self.buf = (ctypes.c_ubyte * ROW_SIZE)()
+
+    def add_rotation(self, rate, periods=1):
+        self.lib.flowsteerAddRotation(int(rate), int(periods))
+
+    def add_row(self, row_num, pixels, is_last):
+        '''Returns a step (flow left, flow right, imbalance, output, compute
+        time [s]) if the row completed a frame, else None.'''
+        ctypes.memmove(self.buf, np.ascontiguousarray(pixels, np.uint8) \
+                                                    .ctypes.data, ROW_SIZE)
+        t = time.time()
+        done = self.lib.flowsteerAddRow(int(row_num), self.buf, int(is_last))
+        t = time.time() - t
+        if not done:
+            return None
+        return (self.lib.flowsteerGetFlow(0), self.lib.flowsteerGetFlow(1),
+                self.lib.flowsteerGetImbalance(),
+                self.lib.flowsteerGetOutput(), t)
+
+
+def frame_ends(header, row_num, has_row):
+    '''Which rows closed a frame on board, as cambuffIsLastRow tells from the
+    run's row schedule. The board learns the frame size once a frame ended,
+    so the first frame is left to flowsteer.c's wrap fallback.'''
+    ends = np.zeros(row_num.size, dtype=bool)
+    if not has_row.any():
+        return ends
+    frame_rows = int(row_num[has_row].max()) + 1
+    if 'row_sched_mode' in header.dtype.names:
+        mode   = int(header['row_sched_mode'])
+        period = max(1, int(header['row_sched_period']))
+        mask   = np.unpackbits(np.array(header['row_sched_mask'], np.uint8), \
+                                                        bitorder='little')
+    else:
+        print('W: Run header lacks the row schedule, frames end on the ' \
+              'highest row seen')
+        mode, period, mask = 0, 1, None
+
+    wrapped, last = False, None
+    for i in np.flatnonzero(has_row):
+        row     = int(row_num[i])
+        wrapped = wrapped or (last is not None and row < last)
+        last    = row
+        if not wrapped:
+            continue
+        if mode in (SCHED_EVERY_KTH, SCHED_ROUND_ROBIN):
+            ends[i] = row + period >= frame_rows
+        elif mode == SCHED_ROW_SET:
+            ends[i] = not mask[row + 1:frame_rows].any()
+        else:
+            ends[i] = row + 1 >= frame_rows
+    return ends
+
+
+def replay(a):
+    shelf = shelve.open(a.session, 'r')
+    d     = shelf['d']
+    shelf.close()
+
+    r      = d.runs[a.run] if a.run is not None else d
+    count  = r.sample_cnt
+    sample = r.sample[:count]
+    bias   = int(r.gyro_bias[2]) if getattr(r, 'gyro_bias', None) is not None \
+                                                                        else 0
+    header = r.header
+    ctrl   = Controller(*[getattr(a, name) if getattr(a, name) is not None
+                          else int(header['settings']['steer_' + name])
+                          for name in ('kp', 'kd', 'derot')])
+
+    # Rows were steered on at 8 bits, before the gate, and derotated with
+    # the gyro rates, so the replay is only exact if all of them were kept
+    lossy  = []
+    if int(header['pixel_depth']) < 8:
+        lossy.append('rows stored at %d bits' % header['pixel_depth'])
+    if int(header['settings']['row_gate']):
+        lossy.append('rows gated, unchanged ones replayed as last stored')
+    if int(header['attitude_log']) == layout.const.ATTITUDE_IN_GYRO:
+        lossy.append('gyro rates not logged, flow not derotated')
+    if lossy:
+        print('W: Replay inexact, ' + ', '.join(lossy))
+
+    # Quiet samples may stand for several sampling periods, see sampleskip.h
+    period  = int(r.header['sampling_period']) if count else 1
+    periods = np.ones(count, dtype=int)
+    periods[1:] = np.maximum(1, np.round((np.diff( \
+        sample['gyro_ts'].astype(np.int64)) % 2**32) / float(period)))
+
+    has_row = sample['row_valid'] != layout.const.ROW_NONE
+    is_last = frame_ends(header, sample['row_num'], has_row)
+
+    # The row of a sample is added before its gyro value, as on board
+    steps = []
+    for i in range(count):
+        step = None
+        if has_row[i]:
+            step = ctrl.add_row(sample['row_num'][i], sample['row'][i], \
+                                                                is_last[i])
+        ctrl.add_rotation(sample['gyro'][i][2] - bias, periods[i])
+        if step is not None:
+            steps.append(step)
+
+    # Steps are paired in order, whichever sample they landed on
+    report(steps)
+    stepped = sample['steer_latency'] > 0
+    latency = sample['steer_latency'][stepped]
+    board   = sample['steer_pdc'][stepped].astype(int)
+    host    = np.array([step[3] for step in steps], dtype=int)
+    paired  = min(board.size, host.size)
+    error   = np.abs(host[:paired] - board[:paired])
+    missed  = abs(board.size - host.size)
+    if latency.size:
+        print('I: On board, %d steps, latency %.2f ms mean, %.2f ms p95, '  \
+              '%.2f ms max' % (latency.size, latency.mean() / 1E3,         \
+              np.percentile(latency, 95) / 1E3, latency.max() / 1E3))
+        print('I: Replayed outputs match %d of %d on-board steps, '         \
+              '%d steps unpaired, %.1f mean difference' % (np.sum(error == 0),
+              board.size, missed, error.mean() if paired else 0.))
+    else:
+        print('I: Run was not steered on board, nothing to compare')
+        return
+    checks = firmsim.Checks()
+    checks.check('Steps unpaired with the board', missed, 0)
+    if not lossy:
+        checks.check('Steps differing from the board', \
+                                        int(np.sum(error != 0)), 0)
+    elif paired:
+        checks.check('Mean output difference from the board', \
+                                                error.mean(), a.pdc_tol)
+    checks.exit()
+
+
+def corridor(a):
+    '''Closed-loop run down a corridor, returning lateral offsets [m].'''
+    rng     = np.random.RandomState(a.seed)
+    texture = np.convolve(rng.uniform(0, 255, 4096), np.ones(8) / 8, 'same')
+    derot   = a.derot if a.derot is not None else \
+                        int(round(a.focal / BIN_SIZE * 2**8 * 2**16 * 1E-6))
+    ctrl    = Controller(a.kp if a.kp is not None else -200,
+                         a.kd if a.kd is not None else -1000, derot)
+    half    = ROW_SIZE // 2
+    shift   = [0., 0.]          # [pixels] of each wall's texture
+    y, psi  = a.offset, 0.      # [m] towards the left wall, [rad]
+    dt      = 1. / FPS
+    offsets, steps, pdc = [], [], 0
+
+    for frame in range(int(a.t * FPS)):
+        # Walls sweep outwards, faster the closer they are, and turning
+        # sweeps both of them the same way
+        psi_dot = a.turn_rate * float(pdc) / layout.const.MOTOR_PDC_MAX
+        for side, d_wall in ((0, a.width / 2 - y), (1, a.width / 2 + y)):
+            shift[side] += a.focal * a.speed * dt / max(d_wall, .01)
+        shift[0] -= a.focal * psi_dot * dt
+        shift[1] += a.focal * psi_dot * dt
+        left  = np.interp(np.arange(half) + shift[0], \
+                                np.arange(texture.size), texture)
+        right = np.interp(np.arange(half) - shift[1] + 2048, \
+                                np.arange(texture.size), texture)
+        pixels = np.concatenate((left, right))
+
+        # Rows and gyro samples interleave over the frame, as on board
+        for row_num in range(ROWS):
+            noisy = pixels + rng.normal(0, a.noise, ROW_SIZE)
+            step  = ctrl.add_row(row_num, np.clip(noisy, 0, 255), \
+                                                        row_num == ROWS - 1)
+            if step is not None:
+                steps.append(step)
+                pdc = step[3]
+            if row_num % (ROWS // SAMPLES) == 0:
+                ctrl.add_rotation(1E3 * psi_dot)
+
+        # Positive duty cycles turn left, see mcSteerPdc
+        psi += psi_dot * dt
+        y   += a.speed * np.sin(psi) * dt
+        offsets.append(y)
+
+    report(steps)
+    print('I: Offset from the centre %+.3f m at start, %+.3f m at the end, ' \
+          '%.3f m max' % (a.offset, offsets[-1], np.abs(offsets).max()))
+    checks = firmsim.Checks()
+    checks.check('Offset at the end [m]', abs(offsets[-1]), a.tol)
+    checks.exit()
+
+
+def report(steps):
+    if not steps:
+        print('W: No complete frames')
+        return
+    steps = np.array(steps)
+    print('I: %d frames, flow %.2f | %.2f bins/frame mean magnitude, '        \
+          'imbalance %+.2f mean, output %+.0f mean, %.1f us per step on host' \
+          % (len(steps), np.abs(steps[:, 0]).mean() / 256,                    \
+             np.abs(steps[:, 1]).mean() / 256, steps[:, 2].mean() / 256,      \
+             steps[:, 3].mean(), 1E6 * steps[:, 4].mean()))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('session', nargs='?',
+                        help='shelf saved by sensor_dump.py')
+    parser.add_argument('--run',       type=int,   default=None,
+                        help='run read back from the catalog, not the latest')
+    parser.add_argument('--kp',        type=int,   default=None,
+                        help='[duty cycle register] at full imbalance')
+    parser.add_argument('--kd',        type=int,   default=None,
+                        help='[duty cycle register] at full imbalance change')
+    parser.add_argument('--derot',     type=int,   default=None,
+                        help='yaw rate to flow scale, see flowsteer.h')
+    parser.add_argument('--offset',    type=float, default=.1,  help='[m]')
+    parser.add_argument('--width',     type=float, default=.5,  help='[m]')
+    parser.add_argument('--speed',     type=float, default=.3,  help='[m/s]')
+    parser.add_argument('--turn-rate', type=float, default=3.,
+                        help='[rad/s] at full steering')
+    parser.add_argument('--focal',     type=float, default=20.,
+                        help='[pixels] focal length of the camera rows')
+    parser.add_argument('--noise',     type=float, default=2.,
+                        help='[pixel values] per row')
+    parser.add_argument('--t',         type=float, default=10., help='[s]')
+    parser.add_argument('--seed',      type=int,   default=1)
+    parser.add_argument('--tol',       type=float, default=.03,
+                        help='[m] offset at the end, corridor only')
+    parser.add_argument('--pdc-tol',   type=float,
+                        default=.05 * layout.const.MOTOR_PDC_MAX,
+                        help='[duty cycle register] mean output difference '
+                             'from the board, for rows stored lossy')
+    a = parser.parse_args()
+
+    if a.session:
+        replay(a)
+    else:
+        corridor(a)
+
+
+if __name__ == '__main__':
+    main()
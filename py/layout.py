@@ -0,0 +1,817 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Record layouts and command table shared by the firmware and the host
+#
+# This is the single source of truth for everything that crosses the radio
+# or sits in flash. Host scripts import it to get the command IDs and numpy
+# dtypes, while running it regenerates the firmware header (../layout.h):
+#
+#   python py/layout.py
+#
+# Notes:
+#  - Field counts may name one of the constants below.
+#  - Field types may name a record defined earlier, which gets nested.
+#  - Types follow numpy's notation and are always little-endian, matching the
+#    dsPIC's memory image. Multi-byte fields must be word aligned, since the
+#    dsPIC cannot do unaligned accesses and its structs are not packed.
+#
+
+import os, binascii
+import numpy as np
+
+
+# Constants: (name, value, comment)
+CONSTANTS = [
+    ('ROW_SIZE',           152, '[bytes] camera image row'),
+    ('MEM_PAGE_SIZE',      528, '[bytes] DataFlash page'),
+    ('MEM_PAGE_DATA_SIZE', 526, '[bytes] page data, followed by its CRC'),
+    ('MEM_SECTOR_SIZE',    256, '[pages] AT45DB161D sector, erase unit'),
+    ('MEM_PAGE_COUNT',    4096, '[pages] AT45DB161D'),
+    ('CATALOG_PAGE',         0, 'flash page holding the run catalog'),
+    ('CATALOG_MAX_RUNS',    12, 'runs the catalog can hold'),
+    ('MOTOR_PDC_MAX',     1248, 'duty cycle register at 100% (2*PTPER)'),
+    ('GYRO_BIAS_FRAC_BITS',  4, 'fractional bits of gyro_bias'),
+    ('ROW_NONE',             0, 'row_valid: no row was captured'),
+    ('ROW_STORED',           1, 'row_valid: its pixels follow'),
+    ('ROW_UNCHANGED',        2, 'row_valid: as last stored for row_num'),
+    ('PIXEL_LINEAR',         0, 'pixel_compand: none'),
+    ('PIXEL_GAMMA',          1, 'pixel_compand: square root'),
+    ('PIXEL_LOG',            2, 'pixel_compand: logarithm'),
+    ('ATTITUDE_RATE_SCALE', 42719, 'ITG-3200 count*us to 2^-30 rad/2, Q16'),
+    ('ATTITUDE_OFF',         0, 'attitude_log: not logged'),
+    ('ATTITUDE_APPENDED',    1, 'attitude_log: AttitudeRecord after samples'),
+    ('ATTITUDE_IN_GYRO',     2, 'attitude_log: in place of the gyro rates'),
+    ('READ_SLICES',          8, 'readback stats timeline, over the pages'),
+    ('RUN_THUMB_SIZE',      32, 'run summary thumbnail, over the samples'),
+    ('ROW_CORR_DARK',        0, 'CalibrateRowsArgs phase: lens covered'),
+    ('ROW_CORR_FLAT',        1, 'CalibrateRowsArgs phase: uniform light'),
+    ('ROW_CORR_GAIN_BITS',  12, 'fractional bits of row correction gains'),
+    ('ROW_CORR_CHUNK',      16, '[columns] per RowCorrChunkRecord'),
+    ('SEQ_MAX_STEPS',       24, 'steps a sequence can hold'),
+    ('SEQ_ARGS_SIZE',       16, '[bytes] of arguments per step'),
+    ('SEQ_WAIT',           240, 'step cmd: pause, see SeqWaitArgs'),
+    ('SEQ_REPEAT',         241, 'step cmd: loop back, see SeqRepeatArgs'),
+    ('SEQ_IDLE',             0, 'SequenceProgressRecord state: not run yet'),
+    ('SEQ_RUNNING',          1, 'SequenceProgressRecord state: step started'),
+    ('SEQ_DONE',             2, 'SequenceProgressRecord state: ran to the end'),
+    ('SEQ_STOPPED',          3, 'SequenceProgressRecord state: by the host'),
+    ('SEQ_FAILED',           4, 'SequenceProgressRecord state: bad step'),
+]
+
+# Records: (name, [(field, type, count, comment), ...])
+RECORDS = [
+    ('SampleRecord', [
+        ('id',               'u2',   1, 'sample number, wrapping'),
+        ('bemf_ts',          'u4',   1, ''),
+        ('bemf',             'u2',   1, 'main motor Back-EMF'),
+        ('motor_pdc',        'u2',   1, 'main motor duty cycle register'),
+        ('motor_err',        'i2',   1, 'speed controller error'),
+        ('steer_pdc',        'i2',   1, 'flow steering output'),
+        ('steer_latency',    'u2',   1, '[us] row capture to steering PWM'),
+        ('gyro_ts',          'u4',   1, ''),
+        ('gyro',             'i2',   3, 'raw gyro values, see attitude_log'),
+        ('row_ts',           'u4',   1, ''),
+        ('row_num',          'u1',   1, 'physical row number'),
+        ('row_valid',        'u1',   1, 'ROW_NONE, _STORED or _UNCHANGED'),
+    ]),
+    ('AttitudeRecord', [
+        ('attitude',         'i2',   3, 'Q15 quaternion x, y, z, with w >= 0'),
+    ]),
+    ('RowRecord', [
+        ('row',              'u1', 'ROW_SIZE', 'camera image row'),
+    ]),
+    ('SettingsRecord', [
+        ('sampling_period',  'u4',   1, '[us]'),
+        ('motor_duty_cycle', 'f4',   1, '[%]'),
+        ('mem_page_start',   'u2',   1, ''),
+        ('speed_setpoint',   'u2',   1, '[ADC counts] target Back-EMF'),
+        ('speed_kp',         'i2',   1, 'Q8.8'),
+        ('speed_ki',         'i2',   1, 'Q8.8'),
+        ('speed_ctrl',       'u1',   1, 'closed-loop motor control?'),
+        ('steer_ctrl',       'u1',   1, 'steering from visual flow?'),
+        ('gyro_bias',        'i2',   3, '[counts] online estimate'),
+        ('gyro_bias_conf',   'u1',   1, 'stationary windows averaged'),
+        ('gyro_bias_age',    'u1',   1, 'windows since last update'),
+        ('row_gate',         'u2',   1, 'SAD threshold, 0 stores all rows'),
+        ('steer_kp',         'i2',   1, 'steering at full flow imbalance'),
+        ('steer_kd',         'i2',   1, '...and at its change over a frame'),
+        ('steer_derot',      'i2',   1, 'yaw rate to flow, see flowsteer.h'),
+        ('skip_gyro_full',   'u2',   1, '[counts] |x|+|y|+|z| at full rate'),
+        ('skip_bemf_full',   'u2',   1, '[ADC counts] change at full rate'),
+        ('sample_skip_max',  'u1',   1, 'periods between quiet samples'),
+        ('pixel_depth',      'u1',   1, '[bits] stored per pixel: 8, 6 or 4'),
+        ('pixel_compand',    'u1',   1, 'PIXEL_LINEAR, _GAMMA or _LOG'),
+        ('pixel_dither',     'u1',   1, 'ordered dither when quantising?'),
+        ('attitude_period',  'u2',   1, '[us] between gyro reads, 0: off'),
+        ('attitude_log',     'u1',   1, 'ATTITUDE_OFF, _APPENDED or _IN_GYRO'),
+        ('pad',              'u1',   1, ''),
+    ]),
+    ('RunHeaderRecord', [
+        ('start_time',       'u4',   1, '[us]'),
+        ('samples',          'u4',   1, 'SampleRecords that follow'),
+        ('sampling_period',  'u4',   1, '[us]'),
+        ('sample_size',      'u2',   1, '[bytes] per SampleRecord'),
+        ('row_size',         'u2',   1, '[bytes] per RowRecord'),
+        ('gyro_bias',        'i2',   3, '[counts] at the start of the run'),
+        ('gyro_bias_conf',   'u1',   1, ''),
+        ('gyro_bias_age',    'u1',   1, ''),
+        ('sample_skip_max',  'u1',   1, '1: every sampling_period'),
+        ('pixel_depth',      'u1',   1, 'see SettingsRecord'),
+        ('pixel_compand',    'u1',   1, ''),
+        ('pixel_dither',     'u1',   1, ''),
+        ('attitude_period',  'u2',   1, '[us] 0: attitude not integrated'),
+        ('row_corr',         'u1',   1, 'rows corrected, see RowCorrInfo'),
+        ('attitude_log',     'u1',   1, 'see SettingsRecord'),
+        ('row_sched_mode',   'u1',   1, 'as set by SET_ROW_SCHEDULE'),
+        ('row_sched_period', 'u1',   1, ''),
+        ('row_sched_phase',  'u1',   1, ''),
+        ('row_sched_pad',    'u1',   1, ''),
+        ('row_sched_mask',   'u1',  32, '1 bit per row_num'),
+        ('settings',  'SettingsRecord', 1, 'as the run started'),
+    ]),
+    ('RunEntryRecord', [
+        ('timestamp',        'u4',   1, '[s] host clock'),
+        ('samples',          'u4',   1, ''),
+        ('rows_stored',      'u4',   1, ''),
+        ('rows_unchanged',   'u4',   1, 'gated by row_gate'),
+        ('start_page',       'u2',   1, ''),
+        ('pages',            'u2',   1, ''),
+    ]),
+    ('CatalogRecord', [
+        ('runs',             'u2',   1, ''),
+        ('run',   'RunEntryRecord', 'CATALOG_MAX_RUNS', ''),
+        ('crc',              'u2',   1, 'CRC-16-CCITT of the fields above'),
+    ]),
+    ('GyroCalibRecord', [
+        ('offset',           'f4',   3, 'gyro offsets'),
+    ]),
+    ('RowCorrInfoRecord', [
+        ('enabled',          'u1',   1, 'applied to rows as they are taken?'),
+        ('calibrated',       'u1',   1, 'bit per ROW_CORR_DARK, _FLAT phase'),
+        ('rows',             'u1',   1, 'averaged by the last calibration'),
+        ('phase',            'u1',   1, '...and its phase'),
+        ('level',            'u2',   1, '[pixel values] Q4, mean flat response'),
+        ('bench_rows',       'u2',   1, 'corrected to time each pass'),
+        ('bench_time',       'u4',   1, '[us] of the pass used on rows'),
+        ('bench_time_c',     'u4',   1, '[us] of the portable C pass'),
+    ]),
+    ('RowCorrChunkRecord', [
+        ('first',            'u2',   1, 'column'),
+        ('offset',           'i2', 'ROW_CORR_CHUNK', '[pixel values] dark'),
+        ('gain',             'i2', 'ROW_CORR_CHUNK',
+                                        'ROW_CORR_GAIN_BITS fractional'),
+    ]),
+    ('EraseMemoryArgs', [
+        ('samples',          'u4',   1, ''),
+    ]),
+    ('RecordSensorDumpArgs', [
+        ('timestamp',        'u4',   1, '[s] host clock'),
+        ('samples',          'u4',   1, ''),
+        ('sample_motor_on',  'u4',   1, ''),
+        ('sample_motor_off', 'u4',   1, ''),
+    ]),
+    ('ReadMemoryArgs', [
+        ('samples',          'u4',   1, ''),
+        ('pld_size',         'u2',   1, '[bytes] per packet'),
+    ]),
+    ('ReadPagesArgs', [
+        ('first',            'u2',   1, 'relative to the run last read'),
+        ('count',            'u2',   1, '[pages]'),
+        ('pld_size',         'u2',   1, '[bytes] per packet'),
+    ]),
+    ('ReadRunArgs', [
+        ('run',              'u2',   1, 'index in the catalog'),
+        ('pld_size',         'u2',   1, '[bytes] per packet'),
+    ]),
+    ('TimeSyncArgs', [
+        ('seq',              'u2',   1, 'echoed back'),
+    ]),
+    ('TimeSyncRecord', [
+        ('time',             'u4',   1, '[us] sclock when answered'),
+        ('seq',              'u2',   1, 'from TimeSyncArgs'),
+    ]),
+    ('ReadStatsRecord', [
+        ('time',             'u4',   1, '[us] spent sending pages'),
+        ('flash_wait',       'u4',   1, '[us] of it waiting on the flash'),
+        ('radio_wait',       'u4',   1, '[us] of it waiting on the radio'),
+        ('pages',            'u2',   1, 'sent since the last full read'),
+        ('packets',          'u2',   1, ''),
+        ('request_retries',  'u2',   1, 'no free packet to fill'),
+        ('enqueue_retries',  'u2',   1, 'TX queue full'),
+        ('acks_checked',     'u2',   1, 'packets whose outcome was seen'),
+        ('ack_fails',        'u2',   1, 'of them, not acknowledged'),
+        ('txq_sum',          'u4',   1, '[packets] TX queue after each enqueue'),
+        ('txq_max',          'u1',   1, '[packets]'),
+        ('txq_size',         'u1',   1, '[packets] TXPQ_MAX_SIZE'),
+        ('pld_size',         'u2',   1, '[bytes] payload of the last read'),
+    ]),
+    ('ReadSliceRecord', [
+        ('time',             'u4',   1, '[us] spent sending its pages'),
+        ('pages',            'u2',   1, ''),
+        ('packets',          'u2',   1, ''),
+        ('enqueue_retries',  'u2',   1, ''),
+        ('ack_fails',        'u2',   1, ''),
+        ('txq_sum',          'u4',   1, '[packets]'),
+    ]),
+    ('SteerStatsRecord', [
+        ('steps',            'u4',   1, 'frames steered on, last run'),
+        ('latency_sum',      'u4',   1, '[us] row capture to steering PWM'),
+        ('latency_max',      'u4',   1, '[us]'),
+        ('detect_max',       'u4',   1, '[us] until the frame was complete'),
+        ('compute_max',      'u4',   1, '[us] from then to the PWM update'),
+    ]),
+    ('RunSummaryRecord', [
+        ('samples',          'u4',   1, 'taken, last run'),
+        ('slots',            'u4',   1, 'sampling periods they covered'),
+        ('rows_none',        'u4',   1, 'samples by row_valid'),
+        ('rows_stored',      'u4',   1, ''),
+        ('rows_unchanged',   'u4',   1, ''),
+        ('late_max',         'u4',   1, '[us] a sample was taken late'),
+        ('late',             'u2',   1, 'samples over a sampling period late'),
+        ('row_overruns',     'u2',   1, 'rows lost to a full camera buffer'),
+        ('gyro_min',         'i2',   3, '[counts]'),
+        ('gyro_max',         'i2',   3, '[counts]'),
+        ('gyro_mean',        'i2',   3, '[counts]'),
+        ('gyro_saturated',   'u2',   1, 'samples with an axis at full scale'),
+        ('bemf_min',         'u2',   1, '[ADC counts]'),
+        ('bemf_max',         'u2',   1, '[ADC counts]'),
+        ('bemf_mean',        'u2',   1, '[ADC counts]'),
+        ('thumb',            'u1', 'RUN_THUMB_SIZE',
+                                        'mean row intensity, 0: no rows'),
+    ]),
+    ('SequenceStepRecord', [
+        ('cmd',              'u1',   1, 'CMD_* id, SEQ_WAIT or SEQ_REPEAT'),
+        ('length',           'u1',   1, '[bytes] of args used'),
+        ('args',             'u1', 'SEQ_ARGS_SIZE', 'as the command takes'),
+    ]),
+    ('SequenceProgressRecord', [
+        ('state',            'u1',   1, 'SEQ_*'),
+        ('step',             'u1',   1, 'index of the step started or last'),
+        ('cmd',              'u1',   1, '...and its cmd'),
+        ('reserved',         'u1',   1, ''),
+        ('executed',         'u2',   1, 'steps started since RUN_SEQUENCE'),
+        ('time',             'u4',   1, '[us] sclock at the step start'),
+    ]),
+    ('SetSamplingPeriodArgs', [
+        ('sampling_period',  'u4',   1, '[us]'),
+    ]),
+    ('SetMemoryPageStartArgs', [
+        ('mem_page_start',   'u2',   1, ''),
+    ]),
+    ('SetMotorSpeedArgs', [
+        ('motor_duty_cycle', 'f4',   1, '[%]'),
+    ]),
+    ('SetRowGateArgs', [
+        ('row_gate',         'u2',   1, 'SAD threshold, 0 stores all rows'),
+    ]),
+    ('SetSteerCtrlArgs', [
+        ('steer_kp',         'i2',   1, 'duty cycle register, signed'),
+        ('steer_kd',         'i2',   1, 'duty cycle register, signed'),
+        ('steer_derot',      'i2',   1, ''),
+        ('steer_ctrl',       'u1',   1, 'steering from visual flow?'),
+        ('reserved',         'u1',   1, ''),
+    ]),
+    ('SetSampleSkipArgs', [
+        ('skip_gyro_full',   'u2',   1, '0 leaves the gyro out'),
+        ('skip_bemf_full',   'u2',   1, '0 leaves the Back-EMF out'),
+        ('sample_skip_max',  'u1',   1, '1 samples every period'),
+        ('reserved',         'u1',   1, ''),
+    ]),
+    ('SetPixelDepthArgs', [
+        ('pixel_depth',      'u1',   1, '[bits] 8, 6 or 4'),
+        ('pixel_compand',    'u1',   1, 'PIXEL_LINEAR, _GAMMA or _LOG'),
+        ('pixel_dither',     'u1',   1, ''),
+        ('reserved',         'u1',   1, ''),
+    ]),
+    ('SetAttitudeArgs', [
+        ('attitude_period',  'u2',   1, '[us] between gyro reads, 0: off'),
+        ('attitude_log',     'u1',   1, 'ATTITUDE_OFF, _APPENDED or _IN_GYRO'),
+        ('reserved',         'u1',   1, ''),
+    ]),
+    ('CalibrateRowsArgs', [
+        ('phase',            'u1',   1, 'ROW_CORR_DARK or ROW_CORR_FLAT'),
+        ('rows',             'u1',   1, 'to average, up to 255'),
+    ]),
+    ('SetRowCorrArgs', [
+        ('enabled',          'u1',   1, ''),
+        ('pad',              'u1',   1, ''),
+    ]),
+    ('SetRowScheduleArgs', [
+        ('mode',             'u1',   1, 'CAMBUFF_SCHED_*'),
+        ('period',           'u1',   1, ''),
+        ('phase',            'u1',   1, ''),
+        ('row_mask',         'u1',  32, '1 bit per row_num'),
+    ]),
+    ('ProfilePointRecord', [
+        ('time',             'u2',   1, '[ms] since the start of playback'),
+        ('thrust',           'u2',   1, 'duty cycle register or Back-EMF'),
+        ('steer',            'i2',   1, 'signed duty cycle register'),
+    ]),
+    ('SetProfileArgs', [
+        ('first',            'u1',   1, 'index of the first point sent'),
+        ('count',            'u1',   1, 'ProfilePointRecords that follow'),
+    ]),
+    ('ProfileLengthRecord', [
+        ('length',           'u1',   1, 'points held, answering SET_PROFILE'),
+        ('dropped',          'u1',   1, 'points of it out of order or past'),
+    ]),
+    ('SetSequenceArgs', [
+        ('first',            'u1',   1, 'index of the first step sent'),
+        ('count',            'u1',   1, 'SequenceStepRecords that follow'),
+    ]),
+    ('RunSequenceArgs', [
+        ('timestamp',        'u4',   1, '[s] host clock, for recorded runs'),
+        ('run',              'u1',   1, '0 stops a running sequence'),
+        ('reserved',         'u1',   1, ''),
+    ]),
+    ('SeqWaitArgs', [
+        ('time',             'u4',   1, '[ms]'),
+    ]),
+    ('SeqRepeatArgs', [
+        ('first',            'u1',   1, 'step to go back to'),
+        ('count',            'u1',   1, 'times to go back'),
+    ]),
+    ('SetSpeedCtrlArgs', [
+        ('speed_setpoint',   'u2',   1, '[ADC counts] target Back-EMF'),
+        ('speed_kp',         'i2',   1, 'Q8.8'),
+        ('speed_ki',         'i2',   1, 'Q8.8'),
+        ('speed_ctrl',       'u1',   1, 'closed-loop motor control?'),
+        ('reserved',         'u1',   1, ''),
+    ]),
+]
+
+# Commands: (name, id, argument record or None)
+COMMANDS = [
+    ('RESET',                  2, None),
+    ('ERASE_MEMORY',           3, 'EraseMemoryArgs'),
+    ('RECORD_SENSOR_DUMP',     4, 'RecordSensorDumpArgs'),
+    ('READ_MEMORY',            5, 'ReadMemoryArgs'),
+    ('GET_SETTINGS',           6, None),
+    ('SET_SAMPLING_PERIOD',    7, 'SetSamplingPeriodArgs'),
+    ('SET_MEMORY_PAGE_START',  8, 'SetMemoryPageStartArgs'),
+    ('SET_MOTOR_SPEED',        9, 'SetMotorSpeedArgs'),
+    ('CALIBRATE_GYRO',        10, None),
+    ('SET_ROW_SCHEDULE',      11, 'SetRowScheduleArgs'),
+    ('SET_SPEED_CTRL',        12, 'SetSpeedCtrlArgs'),
+    ('SET_PROFILE',           13, 'SetProfileArgs'),
+    ('READ_PAGES',            14, 'ReadPagesArgs'),
+    ('LIST_RUNS',             15, None),
+    ('READ_RUN',              16, 'ReadRunArgs'),
+    ('CLEAR_CATALOG',         17, None),
+    ('TIME_SYNC',             18, 'TimeSyncArgs'),
+    ('SET_ROW_GATE',          19, 'SetRowGateArgs'),
+    ('GET_READ_STATS',        20, None),
+    ('SET_STEER_CTRL',        21, 'SetSteerCtrlArgs'),
+    ('GET_STEER_STATS',       22, None),
+    ('SET_SAMPLE_SKIP',       23, 'SetSampleSkipArgs'),
+    ('SET_PIXEL_DEPTH',       24, 'SetPixelDepthArgs'),
+    ('SET_ATTITUDE',          25, 'SetAttitudeArgs'),
+    ('GET_RUN_SUMMARY',       26, None),
+    ('CALIBRATE_ROWS',        27, 'CalibrateRowsArgs'),
+    ('SET_ROW_CORR',          28, 'SetRowCorrArgs'),
+    ('GET_ROW_CORR',          29, None),
+    ('SET_SEQUENCE',          30, 'SetSequenceArgs'),
+    ('RUN_SEQUENCE',          31, 'RunSequenceArgs'),
+]
+
+
+C_TYPES = {
+    'u1' : 'unsigned char',
+    'i1' : 'signed char',
+    'u2' : 'unsigned int',
+    'i2' : 'int',
+    'u4' : 'unsigned long',
+    'i4' : 'long',
+    'f4' : 'float',
+}
+
+
+class Namespace(object):
+    def __init__(self, items):
+        for key, value in items:
+            setattr(self, key, value)
+
+
+def _count(count):
+    return dict((name, value) for name, value, _ in CONSTANTS).get(count, count)
+
+def _type(typ):
+    return dtypes[typ] if typ in dtypes else np.dtype('<' + typ)
+
+def _dtype(fields):
+    return np.dtype([(str(field), _type(typ), _count(count))          \
+                        if _count(count) > 1 else (str(field), _type(typ)) \
+                     for field, typ, count, _ in fields])
+
+
+const  = Namespace([(name, value) for name, value, _ in CONSTANTS])
+CMD    = Namespace([(name, value) for name, value, _ in COMMANDS])
+dtypes = {}
+for name, fields in RECORDS:
+    dtypes[name] = _dtype(fields)
+
+# Samples as decoded from a run, with their rows
+sample_dtype = np.dtype(dtypes['SampleRecord'].descr + \
+                        dtypes['AttitudeRecord'].descr + \
+                        dtypes['RowRecord'].descr)
+
+
+def pack(record, *values):
+    '''Packs field values, in schema order, into a record's wire format.'''
+    return np.array([tuple(values)], dtype=dtypes[record]).tobytes()
+
+def unpack(record, data):
+    '''Returns a record's fields from its wire format, without copying.'''
+    return np.frombuffer(data, dtype=dtypes[record], count=1)[0]
+
+def unpack_into(bunch, record, data):
+    '''Sets every field of a record as an attribute of bunch.'''
+    rec = unpack(record, data)
+    for field in rec.dtype.names:
+        value = rec[field]
+        setattr(bunch, field, value.item() if value.ndim == 0 else value)
+
+def pack_step(cmd, args=b''):
+    '''SequenceStepRecord running a command, or SEQ_WAIT or SEQ_REPEAT, with
+    its packed arguments.'''
+    if len(args) > const.SEQ_ARGS_SIZE:
+        raise ValueError('%d bytes of arguments do not fit a sequence step' \
+                                                                % len(args))
+    padded = np.frombuffer(bytes(args).ljust(const.SEQ_ARGS_SIZE, b'\0'), \
+                                                                    np.uint8)
+    return pack('SequenceStepRecord', cmd, len(args), padded)
+
+def count_pages(record, count, header=None):
+    '''Number of flash pages taken by count records stored back to back,
+    optionally preceded by a header record.'''
+    size = count * dtypes[record].itemsize + \
+                                (dtypes[header].itemsize if header else 0)
+    return (size + const.MEM_PAGE_DATA_SIZE - 1) // const.MEM_PAGE_DATA_SIZE
+
+def sample_size(attitude_log=0):
+    '''[bytes] stored per sample, besides its row.'''
+    return dtypes['SampleRecord'].itemsize + (dtypes['AttitudeRecord'] \
+            .itemsize if attitude_log == const.ATTITUDE_APPENDED else 0)
+
+def max_run_pages(samples, depth=8, attitude_log=0):
+    '''Flash pages a run may take, i.e. if every sample stores a row.'''
+    size = dtypes['RunHeaderRecord'].itemsize + samples * \
+            (sample_size(attitude_log) + row_size(depth))
+    return (size + const.MEM_PAGE_DATA_SIZE - 1) // const.MEM_PAGE_DATA_SIZE
+
+def max_run_samples(pages, depth=8, attitude_log=0):
+    '''Samples a run is sure to fit in pages, the inverse of max_run_pages.'''
+    size = pages * const.MEM_PAGE_DATA_SIZE - dtypes['RunHeaderRecord'].itemsize
+    return max(0, size) // (sample_size(attitude_log) + row_size(depth))
+
+def page_data(raw, pages):
+    '''Concatenates the data of pages read back from flash, minus CRCs.'''
+    return _pages(raw, pages)[:, :const.MEM_PAGE_DATA_SIZE].tobytes()
+
+def verify_pages(raw, pages):
+    '''Returns the indices of pages whose data does not match their CRC.'''
+    data   = _pages(raw, pages)
+    stored = data[:, const.MEM_PAGE_DATA_SIZE:].copy().view('<u2')[:, 0]
+    crc    = np.array([binascii.crc_hqx(page.tobytes(), 0xFFFF) \
+                        for page in data[:, :const.MEM_PAGE_DATA_SIZE]])
+    return np.flatnonzero(stored != crc)
+
+def page_runs(pages):
+    '''Groups sorted page indices into (first, count) runs.'''
+    runs = []
+    for page in pages:
+        if runs and runs[-1][0] + runs[-1][1] == page:
+            runs[-1][1] += 1
+        else:
+            runs.append([page, 1])
+    return [tuple(run) for run in runs]
+
+def _pages(raw, pages):
+    return np.frombuffer(raw, dtype=np.uint8, \
+            count=pages * const.MEM_PAGE_SIZE).reshape(pages, -1)
+
+def decode(record, data, count, offset=0):
+    '''Views count records stored back to back in data, from offset.'''
+    return np.frombuffer(data, dtype=dtypes[record], count=count, \
+                                                            offset=offset)
+
+def decode_run(data, count, length=None):
+    '''Decodes a run from the first length bytes of its data.
+
+    A run is a RunHeaderRecord followed by SampleRecords, each followed by
+    an AttitudeRecord if the header's attitude_log is ATTITUDE_APPENDED, and
+    by a row if its row_valid is ROW_STORED, packed as the header tells (see
+    pixpack.h). Returns the header and count samples, with their rows
+    unpacked, of which only the first decoded_count are valid. Unchanged
+    rows get the pixels last stored for their row_num. An attitude logged
+    in place of the gyro rates is moved to the attitude field, leaving the
+    rates at 0.'''
+    length = len(data) if length is None else min(length, len(data))
+    raw    = np.frombuffer(data, dtype=np.uint8)
+    header = unpack('RunHeaderRecord', data)
+    log    = int(header['attitude_log'])
+    record = dtypes['SampleRecord'].itemsize
+    fixed  = sample_size(log)
+    valid  = dtypes['SampleRecord'].fields['row_valid'][1]
+    size   = int(header['row_size'])
+
+    # Walk the records, as their size depends on row_valid
+    offsets, offset = np.zeros(count, dtype=int), header.dtype.itemsize
+    for i in range(count):
+        if offset + fixed > length:
+            count = i
+            break
+        stored = raw[offset + valid] == const.ROW_STORED
+        if stored and offset + fixed + size > length:
+            count = i
+            break
+        offsets[i] = offset
+        offset    += fixed + (size if stored else 0)
+
+    sample  = np.zeros(len(offsets), dtype=sample_dtype)
+    records = raw[offsets[:count, None] + np.arange(record)].copy() \
+                                    .view(dtypes['SampleRecord'])[:, 0]
+    for field in records.dtype.names:
+        sample[field][:count] = records[field]
+    if log == const.ATTITUDE_APPENDED:
+        sample['attitude'][:count] = raw[offsets[:count, None] + record + \
+                np.arange(fixed - record)].copy().view(np.dtype('<i2'))
+    elif log == const.ATTITUDE_IN_GYRO:
+        sample['attitude'][:count] = sample['gyro'][:count]
+        sample['gyro'] = 0
+
+    stored = np.flatnonzero(sample['row_valid'][:count] == const.ROW_STORED)
+    sample['row'][stored] = unpack_rows(raw[offsets[stored, None] + fixed + \
+                                np.arange(size)], header['pixel_depth'], \
+                                header['pixel_compand'], header['pixel_dither'])
+
+    last = {}
+    for i in np.flatnonzero(sample['row_valid'][:count] != const.ROW_NONE):
+        if sample['row_valid'][i] == const.ROW_STORED:
+            last[sample['row_num'][i]] = i
+        elif sample['row_num'][i] in last:
+            sample['row'][i] = sample['row'][last[sample['row_num'][i]]]
+
+    return header, sample, count
+
+def row_size(depth):
+    '''[bytes] of a row stored with depth bits per pixel.'''
+    return const.ROW_SIZE // 8 * (int(depth) if depth in (6, 4) else 8)
+
+def compand_table(compand):
+    '''Pixel to companded code, as tabulated in pixpack.c.'''
+    pixel = np.arange(256)
+    if compand == const.PIXEL_GAMMA:
+        return np.array([int(np.sqrt(255 * x)) for x in pixel], np.uint8)
+    if compand == const.PIXEL_LOG:
+        msb = np.floor(np.log2(pixel + 1)).astype(int)
+        log = (msb << 8) + (((pixel + 1) << (8 - msb)) & 0xFF)
+        return ((log * 255) >> 11).astype(np.uint8)
+    return pixel.astype(np.uint8)
+
+BAYER = np.array([[ 0,  8,  2, 10],
+                  [12,  4, 14,  6],
+                  [ 3, 11,  1,  9],
+                  [15,  7, 13,  5]])
+
+def pack_rows(rows, row_nums, depth, compand=0, dither=0):
+    '''Packs rows of pixels as pixpack.c does, e.g. to emulate the board.'''
+    if depth not in (6, 4):
+        depth, dither = 8, 0
+    shift = 8 - depth
+    rows  = compand_table(compand)[np.asarray(rows, np.uint8)].astype(int)
+    if dither:
+        rows += BAYER[np.asarray(row_nums)[:, None] % 4, \
+                        np.arange(const.ROW_SIZE) % 4] >> (4 - shift)
+    else:
+        rows += (1 << shift) >> 1
+    codes  = np.minimum(rows >> shift, (1 << depth) - 1).astype(np.uint64)
+    groups = codes.reshape(len(codes), const.ROW_SIZE // 8, 8) << \
+                                (depth * np.arange(8, dtype=np.uint64))
+    value  = np.bitwise_or.reduce(groups, axis=2)
+    packed = (value[:, :, None] >> (8 * np.arange(depth, dtype=np.uint64))) \
+                                                                    & 0xFF
+    return packed.astype(np.uint8).reshape(len(codes), row_size(depth))
+
+def unpack_rows(packed, depth, compand=0, dither=0):
+    '''Pixels of packed rows, an array of row_size(depth) bytes each, back to
+    8 bits through the inverse of the companding.
+
+    Dithered codes are unbiased on average, so they are taken back the same
+    way as rounded ones, i.e. to the companded value at the code's step.'''
+    packed = np.asarray(packed, np.uint8)
+    if depth not in (6, 4):
+        depth = 8
+        if compand == const.PIXEL_LINEAR:
+            return packed
+    packed = packed.reshape(len(packed), const.ROW_SIZE // 8, depth) \
+                                                        .astype(np.uint64)
+    value  = np.bitwise_or.reduce(packed << \
+                        (8 * np.arange(depth, dtype=np.uint64)), axis=2)
+    codes  = (value[:, :, None] >> (depth * np.arange(8, dtype=np.uint64))) \
+                                                    & ((1 << depth) - 1)
+    codes  = codes.reshape(len(packed), const.ROW_SIZE).astype(int)
+
+    # Companded values are flat in places, where they take the mean pixel
+    table        = compand_table(compand)
+    values, idx  = np.unique(table, return_inverse=True)
+    means        = np.bincount(idx, np.arange(256)) / np.bincount(idx)
+    steps        = np.minimum(np.arange(1 << depth) << (8 - depth), 255)
+    lut = np.round(np.interp(steps, values, means)).astype(np.uint8)
+    return lut[codes]
+
+def resample_run(header, sample, count, fields=('gyro', 'bemf', 'motor_pdc',
+                                              'motor_err', 'steer_pdc')):
+    '''Interpolates fields of a run's samples onto its full-rate grid.
+
+    Samples may be several sampling periods apart when the run adapted its
+    rate to motion, so they are placed by their own timestamps (gyro_ts, or
+    bemf_ts for bemf) rather than their position. Returns the grid, in [us]
+    since the start of the run, and the fields on it. Rows are left out.'''
+    period = int(header['sampling_period'])
+    start  = int(header['start_time'])
+    sample = sample[:count]
+    if not count:
+        return np.zeros(0), dict((field, sample[field]) for field in fields)
+
+    def since_start(ts):
+        # Board time wraps around every 2^32 us
+        return (ts.astype(np.int64) - start) % 2**32
+
+    t    = since_start(sample['gyro_ts'])
+    grid = np.arange(0, t[-1] + 1, period, dtype=np.int64)
+    out  = {}
+    for field in fields:
+        ts     = since_start(sample['bemf_ts']) if field == 'bemf' else t
+        values = sample[field].astype(np.float64)
+        if values.ndim == 1:
+            out[field] = np.interp(grid, ts, values)
+        else:
+            out[field] = np.column_stack([np.interp(grid, ts, values[:, k]) \
+                                            for k in range(values.shape[1])])
+    return grid, out
+
+def summarize_run(sample, count, requested, slot=None):
+    '''RunSummaryRecord of a run's samples, as the recorder keeps it (see
+    runstats.h), for those taken in the given slots of the full-rate grid,
+    out of the requested ones. Slots default to one per sample. Lateness is
+    not known from samples and is left out.'''
+    sample = sample[:count]
+    slot   = np.arange(count) if slot is None else np.asarray(slot)[:count]
+    out    = np.zeros(1, dtype=dtypes['RunSummaryRecord'])[0]
+    out['samples'] = count
+    out['slots']   = slot[-1] + 1 if count else 0
+    for field, value in (('rows_none', const.ROW_NONE),
+                         ('rows_stored', const.ROW_STORED),
+                         ('rows_unchanged', const.ROW_UNCHANGED)):
+        out[field] = np.sum(sample['row_valid'] == value)
+    if not count:
+        return out
+
+    gyro = sample['gyro'].astype(np.int64)
+    out['gyro_min']  = gyro.min(axis=0)
+    out['gyro_max']  = gyro.max(axis=0)
+    out['gyro_mean'] = np.trunc(gyro.sum(axis=0) / float(count))
+    out['gyro_saturated'] = min(0xFFFF, np.sum(np.any(np.abs(gyro) >= \
+                                                        0x7FFF, axis=1)))
+    bemf = sample['bemf'].astype(np.int64)
+    out['bemf_min'], out['bemf_max'] = bemf.min(), bemf.max()
+    out['bemf_mean'] = bemf.sum() // count
+
+    has_row = sample['row_valid'] != const.ROW_NONE
+    bins    = np.minimum(slot * const.RUN_THUMB_SIZE // max(1, requested), \
+                                            const.RUN_THUMB_SIZE - 1)[has_row]
+    sums    = np.bincount(bins, sample['row'][has_row].sum(axis=1), \
+                                            const.RUN_THUMB_SIZE)
+    rows    = np.bincount(bins, minlength=const.RUN_THUMB_SIZE)
+    out['thumb'] = sums // np.maximum(1, rows * const.ROW_SIZE)
+    return out
+
+def attitude_quat(sample, count=None):
+    '''Unit quaternions (w, x, y, z) of the attitudes integrated on board,
+    from the Q15 vector parts logged with w >= 0. w is coarse close to half
+    turns, where it follows from a vector part of length near 1.'''
+    xyz = sample['attitude'][:count].astype(np.float64) / 2**15
+    w   = np.sqrt(np.maximum(0, 1 - np.sum(xyz**2, axis=1)))
+    return np.column_stack((w, xyz))
+
+def correct_rows(rows, offset, gain):
+    '''Rows corrected column by column as rowcorr.c does, with offsets in
+    pixel values and gains in ROW_CORR_GAIN_BITS fractional bits.'''
+    rows  = np.asarray(rows, np.int64)
+    shift = const.ROW_CORR_GAIN_BITS
+    value = ((rows - np.asarray(offset, np.int64)) * \
+                np.asarray(gain, np.int64) + (1 << (shift - 1))) >> shift
+    return np.clip(value, 0, 255).astype(np.uint8)
+
+
+# Firmware header generation
+
+def _check_alignment(name, fields):
+    offset, has_words = 0, False
+    for field, typ, count, _ in fields:
+        size = _type(typ).itemsize
+        if size > 1:
+            has_words = True
+            if offset % 2:
+                raise ValueError(name + '.' + field + ' is not word aligned')
+        offset += size * _count(count)
+    if has_words and offset % 2:
+        raise ValueError(name + ' would get padded by the compiler')
+    return offset
+
+def _c_record(name, fields):
+    size  = _check_alignment(name, fields)
+    width = max(len(C_TYPES.get(typ, typ)) for _, typ, _, _ in fields)
+    lines = ['typedef union {', '    struct {']
+    for field, typ, count, comment in fields:
+        decl = '%-*s %s' % (width, C_TYPES.get(typ, typ), field) + \
+                    ('[%s]' % count if _count(count) > 1 else '') + ';'
+        note = '(%d)' % (_type(typ).itemsize * _count(count))
+        lines.append(('        %-*s// %-6s%s' % (max(36, len(decl) + 1), \
+                                            decl, note, comment)).rstrip())
+    lines += ['    };',
+              '    unsigned char contents[%d];' % size,
+              '} %s;' % name,
+              '']
+    return lines
+
+def c_header():
+    lines = [
+        '/*',
+        ' * Record layouts and command IDs shared by the firmware and the host',
+        ' *',
+        ' * Generated by py/layout.py, do not edit by hand: change the schema',
+        ' * there and regenerate this file instead.',
+        ' */',
+        '',
+        '#ifndef __LAYOUT_H',
+        '#define __LAYOUT_H',
+        '',
+        '',
+        '#include <string.h>',
+        '',
+        '',
+        '/* Constants */',
+    ]
+    width = max(len(name) for name, _, _ in CONSTANTS)
+    for name, value, comment in CONSTANTS:
+        lines.append('#define %-*s %-5d // %s' % (width, name, value, comment))
+
+    lines += ['', '/* Commands */']
+    width = max(len(name) for name, _, _ in COMMANDS) + len('CMD_')
+    for name, value, _ in COMMANDS:
+        lines.append('#define %-*s %d' % (width, 'CMD_' + name, value))
+
+    lines += ['', '', '/* Records */', '']
+    for name, fields in RECORDS:
+        lines += _c_record(name, fields)
+
+    lines += [
+        '',
+        '// Copies a received frame into an argument record (frames are not',
+        '// necessarily aligned). Evaluates to 0 if the frame is too short.',
+        '#define LAYOUT_UNPACK(rec, frame, length)                     \\',
+        '    ( ((length) >= sizeof(rec)) ?                             \\',
+        '        (memcpy((rec).contents, (frame), sizeof(rec)), 1) : 0 )',
+        '',
+        '',
+        '#endif // __LAYOUT_H',
+    ]
+    return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    header = os.path.join(os.path.dirname(os.path.abspath(__file__)), \
+                                                        '..', 'layout.h')
+    with open(header, 'w') as f:
+        f.write(c_header())
+    print('I: Wrote ' + os.path.normpath(header))
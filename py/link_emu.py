@@ -0,0 +1,684 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Emulated radio link to the sensor capture board
+#
+# Link is an in-process stand-in for imageproc_py's radio.radio: it takes the
+# same send() calls and hands payload frames to the same callback, from its
+# own thread. Behind it, Board answers commands the way cmd.c does, out of an
+# emulated DataFlash, so the host's readback and decode paths can be run and
+# timed without a robot, basestation or serial port.
+#
+# Frames are delivered at the rate set by the serial baud and the 802.15.4
+# air rate, after a fixed latency, and may be lost or reordered on their way
+# to the host. Flash reads overlap with transmission, as they do on the board,
+# so the link only waits on the flash when a read takes longer than a frame.
+# Commands to the board are never lost, as they are sent with
+# acknowledgements. Frames lost count as unacknowledged in the board's read
+# stats, and the TX queue is taken as full unless waiting on the flash.
+#
+
+import threading, time, heapq, random, binascii
+import numpy as np
+import layout
+from layout import CMD
+
+
+SERIAL_OVERHEAD = 9     # [bytes] XBee API frame around rf_data
+AIR_OVERHEAD    = 19    # [bytes] 802.15.4 PHY and MAC framing
+AIR_RATE        = 250000 # [bit/s]
+
+READ_TYPES      = (CMD.READ_MEMORY, CMD.READ_PAGES, CMD.READ_RUN)
+TXPQ_MAX_SIZE   = 24    # [packets] as in radio_settings.h
+
+# AT45DB161D sectors, as erased by the chip whatever layout.py says: 0a and
+# 0b, then 256 pages each
+FLASH_SECTORS   = [(0, 8), (8, 256)] + \
+                  [(p, p + 256) for p in range(256, 4096, 256)]
+
+
+class Board(object):
+    '''Sensor capture board, answering commands as cmd.c does.'''
+
+    def __init__(self, read_time=0., clock_drift=0., seed=None):
+        self.read_time   = read_time    # [s] to read a page from flash
+        self.clock_drift = clock_drift  # [ppm] of sclock against the host
+        self.boot_time   = time.time()
+        self.rng         = np.random.RandomState(seed)
+        self.flash     = bytearray(b'\xff' * layout.const.MEM_PAGE_COUNT * \
+                                               layout.const.MEM_PAGE_SIZE)
+        self.catalog   = []
+        self.recorded  = None        # samples of the latest run
+        self.summary   = np.zeros(1, dtype=layout.dtypes['RunSummaryRecord'])[0]
+        self.pkt_count = 0
+        self.read_page_start = 0
+        self.read_stats = np.zeros(1, dtype=layout.dtypes['ReadStatsRecord'])[0]
+        self.read_slices = np.zeros(layout.const.READ_SLICES,
+                                    dtype=layout.dtypes['ReadSliceRecord'])
+        self.read_span   = (0, 1)   # first page and pages the slices cover
+        self.frame_slices = []      # of the frames last sent
+
+        self.settings = np.zeros(1, dtype=layout.dtypes['SettingsRecord'])[0]
+        self.settings['sampling_period'] = 1000
+        self.settings['mem_page_start']  = layout.const.CATALOG_PAGE + \
+                                           layout.const.MEM_SECTOR_SIZE
+        self.settings['sample_skip_max'] = 1
+        self.settings['pixel_depth']     = 8
+
+        # Synthetic rows have no fixed pattern, so the table stays identity
+        self.row_corr = np.zeros(1, dtype=layout.dtypes['RowCorrInfoRecord'])[0]
+        self.row_corr['bench_rows']   = 32
+        self.row_corr['bench_time']   = 32 * 14 * layout.const.ROW_SIZE // 40
+        self.row_corr['bench_time_c'] = 32 * 40 * layout.const.ROW_SIZE // 40
+
+        self.profile  = []          # [ms] times of the points held
+        self.sequence = []          # packed SequenceStepRecords
+
+        self.handlers = {
+            CMD.GET_SETTINGS          : self.get_settings,
+            CMD.SET_SAMPLING_PERIOD   : self.set_sampling_period,
+            CMD.SET_MEMORY_PAGE_START : self.set_memory_page_start,
+            CMD.SET_ROW_GATE          : self.set_row_gate,
+            CMD.SET_MOTOR_SPEED       : self.set_motor_speed,
+            CMD.ERASE_MEMORY          : self.erase_memory,
+            CMD.RECORD_SENSOR_DUMP    : self.record_sensor_dump,
+            CMD.READ_MEMORY           : self.read_memory,
+            CMD.READ_PAGES            : self.read_pages,
+            CMD.READ_RUN              : self.read_run,
+            CMD.LIST_RUNS             : self.list_runs,
+            CMD.CLEAR_CATALOG         : self.clear_catalog,
+            CMD.TIME_SYNC             : self.time_sync,
+            CMD.GET_READ_STATS        : self.get_read_stats,
+            CMD.SET_STEER_CTRL        : self.set_steer_ctrl,
+            CMD.GET_STEER_STATS       : self.get_steer_stats,
+            CMD.SET_SAMPLE_SKIP       : self.set_sample_skip,
+            CMD.SET_PIXEL_DEPTH       : self.set_pixel_depth,
+            CMD.SET_ATTITUDE          : self.set_attitude,
+            CMD.GET_RUN_SUMMARY       : self.get_run_summary,
+            CMD.CALIBRATE_ROWS        : self.calibrate_rows,
+            CMD.SET_ROW_CORR          : self.set_row_corr,
+            CMD.GET_ROW_CORR          : self.get_row_corr,
+            CMD.SET_PROFILE           : self.set_profile,
+            CMD.SET_SEQUENCE          : self.set_sequence,
+            CMD.RUN_SEQUENCE          : self.run_sequence,
+        }
+
+    def handle(self, status, type, data):
+        '''Returns the (status, type, data) frames answering a command.'''
+        handler = self.handlers.get(type)
+        return handler(bytes(data)) if handler else []
+
+    # Commands
+
+    def get_settings(self, data):
+        return [(0, CMD.GET_SETTINGS, self.settings.tobytes())]
+
+    def set_sampling_period(self, data):
+        args = layout.unpack('SetSamplingPeriodArgs', data)
+        self.settings['sampling_period'] = args['sampling_period']
+        return []
+
+    def set_memory_page_start(self, data):
+        args   = layout.unpack('SetMemoryPageStartArgs', data)
+        const  = layout.const
+        sector = const.MEM_SECTOR_SIZE
+        page   = max(int(args['mem_page_start']), const.CATALOG_PAGE + sector)
+        page   = -(-page // sector) * sector
+        self.settings['mem_page_start'] = min(page, const.MEM_PAGE_COUNT)
+        return []
+
+    def set_row_gate(self, data):
+        args = layout.unpack('SetRowGateArgs', data)
+        self.settings['row_gate'] = args['row_gate']
+        return []
+
+    def set_motor_speed(self, data):
+        # Recorded, but synthetic Back-EMF does not follow it
+        args = layout.unpack('SetMotorSpeedArgs', data)
+        self.settings['motor_duty_cycle'] = args['motor_duty_cycle']
+        return []
+
+    def erase_memory(self, data):
+        args  = layout.unpack('EraseMemoryArgs', data)
+        first = self.next_page()
+        last  = min(first + self.count_pages(args['samples']), \
+                                        layout.const.MEM_PAGE_COUNT)
+        size  = layout.const.MEM_PAGE_SIZE
+        for page in range(first, last, layout.const.MEM_SECTOR_SIZE):
+            start, end = [s for s in FLASH_SECTORS if s[0] <= page < s[1]][0]
+            for run in self.catalog:
+                run_end = int(run['start_page']) + int(run['pages'])
+                if start < run_end and int(run['start_page']) < end:
+                    raise RuntimeError('Erasing page %d wipes the run at '
+                        'page %d' % (page, run['start_page']))
+            self.flash[start * size:end * size] = b'\xff' * (end - start) * size
+        return []
+
+    def record_sensor_dump(self, data):
+        args  = layout.unpack('RecordSensorDumpArgs', data)
+        count = int(args['samples'])
+        start = self.next_page()
+        if len(self.catalog) >= layout.const.CATALOG_MAX_RUNS or \
+                start >= layout.const.MEM_PAGE_COUNT:
+            return []
+
+        header = np.zeros(1, dtype=layout.dtypes['RunHeaderRecord'])[0]
+        header['samples']         = count
+        header['sample_size']     = layout.dtypes['SampleRecord'].itemsize
+        header['row_size']        = layout.row_size( \
+                                            self.settings['pixel_depth'])
+        header['sampling_period'] = self.settings['sampling_period']
+        header['sample_skip_max'] = self.settings['sample_skip_max']
+        for field in ('pixel_depth', 'pixel_compand', 'pixel_dither',
+                      'attitude_period', 'attitude_log'):
+            header[field] = self.settings[field]
+        header['row_corr'] = self.row_corr['enabled']
+        header['row_sched_period'] = 1  # rows are never scheduled here
+        header['settings'] = self.settings
+
+        # The run ends early if it fills up the flash
+        room = (layout.const.MEM_PAGE_COUNT - start) * \
+                    layout.const.MEM_PAGE_DATA_SIZE - header.itemsize
+        stream, count = self.encode(self.samples(count), room)
+        self.store(start, header.tobytes() + stream)
+        pages  = -(-(header.itemsize + len(stream)) // \
+                                        layout.const.MEM_PAGE_DATA_SIZE)
+
+        entry = np.zeros(1, dtype=layout.dtypes['RunEntryRecord'])[0]
+        entry['timestamp']  = args['timestamp']
+        entry['start_page'] = start
+        entry['pages']      = pages
+        entry['samples']    = count
+        entry['rows_stored']    = np.sum(self.recorded['row_valid'] == \
+                                            layout.const.ROW_STORED)
+        entry['rows_unchanged'] = np.sum(self.recorded['row_valid'] == \
+                                            layout.const.ROW_UNCHANGED)
+        self.catalog.append(entry)
+        self.summary = layout.summarize_run(self.recorded, count, \
+                                                        int(args['samples']))
+        # The summary has the raw rates, the host gets what was logged
+        if self.settings['attitude_log'] == layout.const.ATTITUDE_IN_GYRO:
+            self.recorded['gyro'] = 0
+        return []
+
+    def read_memory(self, data):
+        args = layout.unpack('ReadMemoryArgs', data)
+        if self.catalog:
+            self.read_page_start = self.catalog[-1]['start_page']
+            pages = self.catalog[-1]['pages']
+        else:
+            self.read_page_start = self.settings['mem_page_start']
+            pages = self.count_pages(args['samples'])
+        return self.send_pages(CMD.READ_MEMORY, self.read_page_start, \
+                                                pages, args['pld_size'])
+
+    def read_pages(self, data):
+        args = layout.unpack('ReadPagesArgs', data)
+        return self.send_pages(CMD.READ_PAGES, \
+                    self.read_page_start + args['first'], args['count'], \
+                                                        args['pld_size'])
+
+    def read_run(self, data):
+        args = layout.unpack('ReadRunArgs', data)
+        if args['run'] >= len(self.catalog):
+            return []
+        entry = self.catalog[args['run']]
+        self.read_page_start = entry['start_page']
+        return self.send_pages(CMD.READ_RUN, entry['start_page'], \
+                                        entry['pages'], args['pld_size'])
+
+    def list_runs(self, data):
+        return [(i, CMD.LIST_RUNS, entry.tobytes()) \
+                                    for i, entry in enumerate(self.catalog)]
+
+    def clear_catalog(self, data):
+        self.catalog = []
+        return []
+
+    def time_sync(self, data):
+        args   = layout.unpack('TimeSyncArgs', data)
+        record = np.zeros(1, dtype=layout.dtypes['TimeSyncRecord'])[0]
+        record['time'] = self.sclock()
+        record['seq']  = args['seq']
+        return [(0, CMD.TIME_SYNC, record.tobytes())]
+
+    def get_read_stats(self, data):
+        return [(0, CMD.GET_READ_STATS, self.read_stats.tobytes())] + \
+               [(i + 1, CMD.GET_READ_STATS, self.read_slices[i].tobytes()) \
+                                for i in range(layout.const.READ_SLICES)]
+
+    def set_steer_ctrl(self, data):
+        args = layout.unpack('SetSteerCtrlArgs', data)
+        for field in ('steer_kp', 'steer_kd', 'steer_derot', 'steer_ctrl'):
+            self.settings[field] = args[field]
+        return []
+
+    def get_steer_stats(self, data):
+        # Synthetic rows are no corridor, so nothing is ever steered on
+        record = np.zeros(1, dtype=layout.dtypes['SteerStatsRecord'])[0]
+        return [(0, CMD.GET_STEER_STATS, record.tobytes())]
+
+    def set_sample_skip(self, data):
+        # Spacing is recorded, but synthetic samples keep to every period
+        args = layout.unpack('SetSampleSkipArgs', data)
+        for field in ('skip_gyro_full', 'skip_bemf_full', 'sample_skip_max'):
+            self.settings[field] = args[field]
+        return []
+
+    def set_pixel_depth(self, data):
+        args = layout.unpack('SetPixelDepthArgs', data)
+        for field in ('pixel_depth', 'pixel_compand', 'pixel_dither'):
+            self.settings[field] = args[field]
+        return []
+
+    def get_run_summary(self, data):
+        return [(0, CMD.GET_RUN_SUMMARY, self.summary.tobytes())]
+
+    def set_attitude(self, data):
+        args = layout.unpack('SetAttitudeArgs', data)
+        self.settings['attitude_period'] = args['attitude_period']
+        self.settings['attitude_log']    = args['attitude_log'] \
+            if args['attitude_period'] and \
+                args['attitude_log'] <= layout.const.ATTITUDE_IN_GYRO else 0
+        return []
+
+    def calibrate_rows(self, data):
+        args = layout.unpack('CalibrateRowsArgs', data)
+        self.row_corr['rows']        = args['rows']
+        self.row_corr['phase']       = args['phase']
+        self.row_corr['calibrated'] |= 1 << int(args['phase'])
+        return self.get_row_corr(data)
+
+    def set_row_corr(self, data):
+        args = layout.unpack('SetRowCorrArgs', data)
+        self.row_corr['enabled'] = args['enabled']
+        return []
+
+    def get_row_corr(self, data):
+        frames = [(0, CMD.GET_ROW_CORR, self.row_corr.tobytes())]
+        for i, first in enumerate(range(0, layout.const.ROW_SIZE, \
+                                        layout.const.ROW_CORR_CHUNK)):
+            chunk = np.zeros(1, dtype=layout.dtypes['RowCorrChunkRecord'])[0]
+            chunk['first'] = first
+            chunk['gain']  = 1 << layout.const.ROW_CORR_GAIN_BITS
+            frames.append((i + 1, CMD.GET_ROW_CORR, chunk.tobytes()))
+        return frames
+
+    def set_profile(self, data):
+        args   = layout.unpack('SetProfileArgs', data)
+        size   = layout.dtypes['SetProfileArgs'].itemsize
+        record = layout.dtypes['ProfilePointRecord'].itemsize
+        if args['first'] == 0:
+            self.profile = []
+        # profile.c holds up to PROFILE_MAX_POINTS, from profile.h, in order
+        # of index and time, and drops the chunk from the first point that
+        # is not
+        count = int(args['count'])
+        for i in range(count):
+            index = int(args['first']) + i
+            point = data[size + i * record:size + (i + 1) * record]
+            if len(point) < record or index >= 32 or \
+                                                index > len(self.profile):
+                break
+            time  = int(layout.unpack('ProfilePointRecord', point)['time'])
+            if index > 0 and time <= self.profile[index - 1] or \
+                index + 1 < len(self.profile) and \
+                                            time >= self.profile[index + 1]:
+                break
+            self.profile[index:index + 1] = [time]
+        else:
+            i = count
+        reply = np.zeros(1, dtype=layout.dtypes['ProfileLengthRecord'])[0]
+        reply['length']  = len(self.profile)
+        reply['dropped'] = count - i
+        return [(0, CMD.SET_PROFILE, reply.tobytes())]
+
+    def set_sequence(self, data):
+        args = layout.unpack('SetSequenceArgs', data)
+        head = layout.dtypes['SetSequenceArgs'].itemsize
+        size = layout.dtypes['SequenceStepRecord'].itemsize
+        if args['first'] == 0:
+            self.sequence = []
+        for i in range(int(args['count'])):
+            index = int(args['first']) + i
+            step  = data[head + i * size:head + (i + 1) * size]
+            if len(step) == size and index == len(self.sequence) and \
+                                    index < layout.const.SEQ_MAX_STEPS:
+                self.sequence.append(step)
+        return []
+
+    def run_sequence(self, data):
+        '''Runs the whole sequence at once, as sequence.c would step through
+        it, waits only adding to the board time of later steps.'''
+        args     = layout.unpack('RunSequenceArgs', data)
+        const    = layout.const
+        progress = np.zeros(1, dtype=layout.dtypes['SequenceProgressRecord'])[0]
+        report   = lambda: [(int(progress['state']), CMD.RUN_SEQUENCE, \
+                                                    progress.tobytes())]
+        if not args['run']:
+            return []
+
+        steps = [layout.unpack('SequenceStepRecord', step) \
+                                                for step in self.sequence]
+        progress['state'] = const.SEQ_DONE if not steps else \
+                                                        const.SEQ_RUNNING
+        for i, step in enumerate(steps):
+            cmd, args_ = int(step['cmd']), step['args'].tobytes()
+            if step['length'] > const.SEQ_ARGS_SIZE or \
+                    (cmd == const.SEQ_REPEAT and (step['length'] < 2 or \
+                        layout.unpack('SeqRepeatArgs', args_)['first'] > i)) \
+                    or (cmd == const.SEQ_WAIT and step['length'] < 4) or \
+                    cmd in (CMD.RESET, CMD.SET_SEQUENCE, CMD.RUN_SEQUENCE):
+                progress['state'], progress['step'] = const.SEQ_FAILED, i
+                progress['cmd'] = cmd
+                return report()
+
+        remaining = [0] * len(steps)
+        def reload(first, last):
+            for j in range(first, last):
+                if steps[j]['cmd'] == const.SEQ_REPEAT:
+                    remaining[j] = int(layout.unpack('SeqRepeatArgs', \
+                                        steps[j]['args'].tobytes())['count'])
+        reload(0, len(steps))
+
+        frames, waited, cursor = [], 0, 0
+        while cursor < len(steps):
+            step  = steps[cursor]
+            cmd   = int(step['cmd'])
+            args_ = step['args'].tobytes()[:int(step['length'])]
+            if cmd == const.SEQ_WAIT:
+                waited += int(layout.unpack('SeqWaitArgs', args_)['time'])
+                cursor += 1
+            elif cmd == const.SEQ_REPEAT:
+                if remaining[cursor]:
+                    remaining[cursor] -= 1
+                    first = int(layout.unpack('SeqRepeatArgs', args_)['first'])
+                    reload(first, cursor)
+                    cursor = first
+                else:
+                    cursor += 1
+            else:
+                progress['step'], progress['cmd'] = cursor, cmd
+                progress['time'] = (self.sclock() + 1000 * waited) % 2**32
+                progress['executed'] += 1
+                frames += report()
+                if cmd == CMD.RECORD_SENSOR_DUMP:
+                    record = layout.unpack('RecordSensorDumpArgs', args_).copy()
+                    record['timestamp'] = args['timestamp'] + waited // 1000
+                    args_ = record.tobytes()
+                frames += self.handle(cursor, cmd, args_)
+                cursor += 1
+
+        progress['state'] = const.SEQ_DONE
+        return frames + report()
+
+    # Helpers
+
+    def sclock(self):
+        '''Board time [us], since the board was created.'''
+        elapsed = time.time() - self.boot_time
+        return int(elapsed * (1E6 + self.clock_drift)) % 2**32
+
+    def count_pages(self, samples):
+        return min(layout.max_run_pages(int(samples), \
+            self.settings['pixel_depth'], self.settings['attitude_log']), \
+                                                layout.const.MEM_PAGE_COUNT)
+
+    def next_page(self):
+        next   = int(self.settings['mem_page_start'])
+        sector = layout.const.MEM_SECTOR_SIZE
+        if self.catalog:
+            last = self.catalog[-1]
+            next = max(next, int(last['start_page']) + int(last['pages']))
+        return -(-next // sector) * sector
+
+    def samples(self, count):
+        '''Synthetic samples: a noisy gyro and an image gradient, drifting
+        every other frame so that the row gate has rows to leave out.'''
+        period = int(self.settings['sampling_period'])
+        s = np.zeros(count, dtype=layout.sample_dtype)
+        s['id']        = np.arange(count) & 0xFFFF
+        s['gyro_ts']   = np.arange(count) * period
+        s['bemf_ts']   = s['gyro_ts'] + 20
+        s['row_ts']    = s['gyro_ts']
+        s['gyro']      = self.rng.normal(0, 5, (count, 3)).astype(int)
+        if self.settings['attitude_log']:
+            s['attitude'] = (np.arange(count)[:, None] * (1, 2, 3)) % 2**14
+        s['bemf']      = 512 + self.rng.randint(-8, 8, count)
+        s['row_num']   = np.arange(count) % 160
+        s['row_valid'] = layout.const.ROW_STORED
+        s['row']       = (np.arange(layout.const.ROW_SIZE)[None, :] + \
+                                np.arange(count)[:, None] // 320) & 0xFF
+        return s
+
+    def encode(self, samples, room):
+        '''Sample stream as the recorder stores it, gating unchanged rows,
+        and the number of samples that fit in room bytes.
+
+        Stands in for camgate with exact comparisons: a row is left out if
+        the row gate is on and it equals the one last stored for its row_num.
+        Updates row_valid in samples to match, and keeps those stored as the
+        latest run recorded, with their rows as the host unpacks them.'''
+        gate, last, stream = self.settings['row_gate'] > 0, {}, []
+        fixed  = np.zeros(1, dtype=layout.dtypes['SampleRecord'])
+        extra  = np.zeros(1, dtype=layout.dtypes['AttitudeRecord'])
+        log    = int(self.settings['attitude_log'])
+        depth  = [self.settings[field] for field in \
+                        ('pixel_depth', 'pixel_compand', 'pixel_dither')]
+        packed = layout.pack_rows(samples['row'], samples['row_num'], *depth)
+        size   = layout.sample_size(log) + packed.shape[1]
+        count  = 0
+        for sample in samples:
+            if room < size:
+                break
+            num = int(sample['row_num'])
+            if gate and num in last and np.array_equal(last[num], \
+                                                            sample['row']):
+                sample['row_valid'] = layout.const.ROW_UNCHANGED
+            else:
+                last[num] = sample['row'].copy()
+            for field in fixed.dtype.names:
+                fixed[field] = sample[field]
+            if log == layout.const.ATTITUDE_IN_GYRO:
+                fixed['gyro'] = sample['attitude']
+            stream.append(fixed.tobytes())
+            if log == layout.const.ATTITUDE_APPENDED:
+                extra['attitude'] = sample['attitude']
+                stream.append(extra.tobytes())
+            room -= layout.sample_size(log)
+            if sample['row_valid'] == layout.const.ROW_STORED:
+                stream.append(packed[count].tobytes())
+                room -= packed.shape[1]
+            count += 1
+        self.recorded = samples[:count]
+        self.recorded['row'] = layout.unpack_rows(packed[:count], *depth)
+        return b''.join(stream), count
+
+    def store(self, page, stream):
+        '''Writes a stream across pages, closing each with its CRC.'''
+        size, data_size = layout.const.MEM_PAGE_SIZE, \
+                                        layout.const.MEM_PAGE_DATA_SIZE
+        for first in range(0, len(stream), data_size):
+            data = stream[first:first + data_size]
+            data = data + b'\0' * (data_size - len(data))
+            crc  = np.array([binascii.crc_hqx(data, 0xFFFF)], '<u2')
+            self.flash[page * size:(page + 1) * size] = data + crc.tobytes()
+            page += 1
+
+    def send_pages(self, type, page, count, pld_size):
+        '''Same packetization as cmdSendPages.'''
+        size, page, count, pld_size = layout.const.MEM_PAGE_SIZE, \
+                                        int(page), int(count), int(pld_size)
+        if pld_size == 0 or pld_size > size:
+            return []
+        if type != CMD.READ_PAGES:
+            self.pkt_count = 0
+            self.read_stats.fill(0)
+            self.read_slices.fill(0)
+            self.read_stats['txq_size'] = TXPQ_MAX_SIZE
+            self.read_span = (page, count)
+        self.read_stats['pld_size'] = pld_size
+
+        # The link fills in times, queueing and acknowledgements per frame
+        frames, self.frame_slices = [], []
+        first, pages = self.read_span
+        for page in range(page, page + count):
+            k = (page - first) * layout.const.READ_SLICES // pages \
+                    if 0 <= page - first < pages else -1
+            for byte in range(0, size - pld_size + 1, pld_size):
+                offset = page * size + byte
+                frames.append((self.pkt_count, type, \
+                                bytes(self.flash[offset:offset + pld_size])))
+                self.frame_slices.append(k)
+                self.pkt_count = (self.pkt_count + 1) % 256
+                self.read_stats['packets'] += 1
+                self.read_slices[k]['packets'] += 1
+            self.read_stats['pages'] += 1
+            self.read_slices[k]['pages'] += 1
+        return frames
+
+
+class Link(object):
+    '''Stand-in for radio.radio, connected to an emulated Board.'''
+
+    def __init__(self, board, callback, baud=230400, loss=0., reorder=0., \
+                 latency=0., speedup=1., seed=None, rssi=40):
+        self.board    = board
+        self.callback = callback
+        self.baud     = baud
+        self.loss     = loss        # probability of losing a frame
+        self.reorder  = reorder     # probability of delaying a frame
+        self.latency  = latency     # [s]
+        self.speedup  = speedup     # divides every emulated duration
+        self.rssi     = rssi        # [-dBm] mean of received frames
+        self.rng      = random.Random(seed)
+        self.rssi_rng = random.Random(seed)
+
+        self.frames_sent = 0
+        self.frames_lost = 0
+
+        self.events  = []           # heap of (time, seq, kind, frame)
+        self.seq     = 0
+        self.t_free  = 0.           # when the link is done with its backlog
+        self.cond    = threading.Condition()
+        self.running = True
+        self.thread  = threading.Thread(target=self.run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def send(self, dest, status, type, data=b''):
+        if isinstance(data, str) and not isinstance(data, bytes):
+            data = data.encode('latin-1')
+        with self.cond:
+            self.push(time.time() + self.latency / self.speedup, 'cmd', \
+                                                (status, type, bytes(data)))
+
+    def close(self):
+        with self.cond:
+            self.running = False
+            self.cond.notify()
+        self.thread.join()
+
+    def push(self, t, kind, frame):
+        heapq.heappush(self.events, (t, self.seq, kind, frame))
+        self.seq += 1
+        self.cond.notify()
+
+    def frame_time(self, length):
+        serial = (length + SERIAL_OVERHEAD) * 10. / self.baud
+        air    = (length + AIR_OVERHEAD) * 8. / AIR_RATE
+        return max(serial, air)
+
+    def transmit(self, now, frames):
+        # Frames queue up behind each other, at the slower of both links
+        self.t_free = max(self.t_free, now)
+        t_start, t_page, flash_wait = self.t_free, self.t_free, 0.
+        reading = bool(frames) and frames[0][1] in READ_TYPES
+        stats, slices = self.board.read_stats, self.board.read_slices
+        for i, (status, type, data) in enumerate(frames):
+            length = len(data) + 2
+            k      = self.board.frame_slices[i] if reading else 0
+            t_last = self.t_free
+            if reading and i % (layout.const.MEM_PAGE_SIZE // len(data)) == 0:
+                # A page goes out once read, while the next one is read
+                t_page += self.board.read_time / self.speedup
+                flash_wait += max(0., t_page - self.t_free)
+                self.t_free = t_page = max(t_page, self.t_free)
+            if reading:
+                # The flash keeps the queue full whenever it is ahead
+                queued = TXPQ_MAX_SIZE if t_page <= t_last else 1
+                stats['txq_sum'] += queued
+                slices[k]['txq_sum'] += queued
+                stats['txq_max'] = max(stats['txq_max'], queued)
+                if queued == TXPQ_MAX_SIZE:
+                    stats['enqueue_retries'] += 1
+                    slices[k]['enqueue_retries'] += 1
+            self.t_free += self.frame_time(length) / self.speedup
+            if reading:
+                slices[k]['time'] += int((self.t_free - t_last) * \
+                                                        self.speedup * 1E6)
+                stats['acks_checked'] += 1
+            self.frames_sent += 1
+            if self.rng.random() < self.loss:
+                self.frames_lost += 1
+                if reading:
+                    stats['ack_fails'] += 1
+                    slices[k]['ack_fails'] += 1
+                continue
+            t = self.t_free + self.latency / self.speedup
+            if self.rng.random() < self.reorder:
+                t += 2 * self.frame_time(length) / self.speedup
+            self.push(t, 'rx', (status, type, data))
+
+        if reading:
+            elapsed = (self.t_free - t_start) * self.speedup
+            stats['time']       += int(elapsed * 1E6)
+            stats['flash_wait'] += int(flash_wait * self.speedup * 1E6)
+            stats['radio_wait'] += int((elapsed - flash_wait * self.speedup) \
+                                                                    * 1E6)
+
+    def run(self):
+        while True:
+            with self.cond:
+                while self.running and (not self.events or \
+                                        self.events[0][0] > time.time()):
+                    timeout = self.events[0][0] - time.time() \
+                                                if self.events else None
+                    self.cond.wait(timeout)
+                if not self.running:
+                    return
+                t, _, kind, frame = heapq.heappop(self.events)
+                if kind == 'cmd':
+                    self.transmit(t, self.board.handle(*frame))
+                    continue
+            status, type, data = frame
+            rssi = int(round(self.rssi_rng.gauss(self.rssi, 3)))
+            self.callback({'rf_data' : bytes(bytearray([status, type])) + \
+                           data, 'rssi' : bytes(bytearray([rssi & 0xFF]))})
@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Check the on-board row packing against its host model
+#
+# Builds pixpack.c through firmsim and packs random rows, plus black, white
+# and ramp rows, in every mode: 8, 6 or 4 bits, each companding, with and
+# without dithering. Packed rows must match layout.pack_rows byte for byte,
+# as sensor_dump.py unpacks them with its inverse. The error of taking the
+# rows back to pixels is reported for each mode.
+#
+#   python pixpack_check.py --rows 256
+#
+
+import ctypes, argparse
+import numpy as np
+import firmsim, layout
+
+
+ROW_SIZE = layout.const.ROW_SIZE
+COMPANDS = (('linear', layout.const.PIXEL_LINEAR),
+            ('gamma',  layout.const.PIXEL_GAMMA),
+            ('log',    layout.const.PIXEL_LOG))
+
+
+class Packer(object):
+    '''pixpack.c, packing rows of numpy arrays.'''
+
+    def __init__(self):
+        self.lib = firmsim.load('pixpack')
+        self.buf = (ctypes.c_ubyte * ROW_SIZE)()
+
+    def setup(self, depth, compand, dither):
+        self.lib.pixpackSetup(depth, compand, dither)
+        return self.lib.pixpackRowSize()
+
+    def pack(self, row_num, pixels):
+        ctypes.memmove(self.buf, np.ascontiguousarray(pixels, np.uint8) \
+                                                    .ctypes.data, ROW_SIZE)
+        self.lib.pixpackRow(int(row_num), self.buf)
+        size = self.lib.pixpackRowSize()
+        return np.frombuffer(self.buf, np.uint8)[:size].copy()
+
+
+def test_rows(a):
+    '''Rows to pack and their row numbers, covering every dither phase.'''
+    rng  = np.random.RandomState(a.seed)
+    rows = [np.zeros(ROW_SIZE), np.full(ROW_SIZE, 255.),
+            np.arange(ROW_SIZE) * 255. / (ROW_SIZE - 1)]
+    rows += list(rng.randint(0, 256, (a.rows, ROW_SIZE)))
+    return np.array(rows, np.uint8), np.arange(len(rows)) % 256
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--rows', type=int, default=64,
+                        help='random rows per mode')
+    parser.add_argument('--seed', type=int, default=1)
+    a = parser.parse_args()
+
+    packer         = Packer()
+    rows, row_nums = test_rows(a)
+    checks         = firmsim.Checks()
+
+    print(' depth  compand  dither | bytes  mismatched  rms error')
+    for depth in (8, 6, 4):
+        for name, compand in COMPANDS:
+            for dither in (0, 1):
+                size     = packer.setup(depth, compand, dither)
+                board    = np.array([packer.pack(n, row) for n, row in \
+                                                    zip(row_nums, rows)])
+                host     = layout.pack_rows(rows, row_nums, depth, \
+                                                    compand, dither)
+                mismatch = int(np.sum(np.any(board != host, axis=1)))
+                back     = layout.unpack_rows(board, depth, compand, dither)
+                rms      = np.sqrt(np.mean((back.astype(float) - rows)**2))
+                print('%6d  %7s  %6d | %5d  %10d  %9.2f' % \
+                        (depth, name, dither, size, mismatch, rms))
+
+                mode = '%d bits %s%s' % (depth, name, \
+                                            ', dithered' if dither else '')
+                checks.check('Row size off, ' + mode, \
+                                        abs(size - layout.row_size(depth)), 0)
+                checks.check('Rows mismatched, ' + mode, mismatch, 0)
+    checks.exit()
+
+
+if __name__ == '__main__':
+    main()
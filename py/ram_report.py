@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# RAM use per module, from the XC16 linker map file
+#
+# Run by the Makefile after every build, on the map file MPLAB X writes to
+# dist/<conf>/<image type>/. Sums the data memory sections each object file
+# contributes, alongside the heap and stack reserved by the linker, so that
+# RAM growth can be traced back to the module behind it.
+#
+#   python ram_report.py dist/default/production/*.map --symbols 10
+#
+
+import sys, re, os, argparse
+from collections import defaultdict
+
+
+# Data memory sections, should the map file lack its usage summary
+DATA_SECTIONS = re.compile(r'^\.n?(bss|data|dconst|pbss|xbss|ybss)\b')
+
+HEADER  = re.compile(r'^Data Memory\s+\[Origin = (0x[0-9a-fA-F]+), ' \
+                                        r'Length = (0x[0-9a-fA-F]+)\]')
+USAGE   = re.compile(r'^(\S+)\s+0x[0-9a-fA-F]+\s+\d+\s+0x[0-9a-fA-F]+\s+' \
+                                                                r'\((\d+)\)')
+DYNAMIC = re.compile(r'^(heap|stack)\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+\s+' \
+                                                                r'\((\d+)\)')
+OUTPUT  = re.compile(r'^(\.\S+)(\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+)?\s*$')
+INPUT   = re.compile(r'^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+SYMBOL  = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+(_\w+)\s*$')
+
+
+def module_name(path):
+    '''Object file basename, qualified by its archive for libraries.'''
+    match = re.match(r'^(.*)\((.*)\)$', path)
+    if match:
+        return os.path.basename(match.group(1)) + ':' + \
+                            os.path.splitext(match.group(2))[0]
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+def parse(path):
+    '''Returns RAM size, bytes per module and (bytes, module, symbol).'''
+    ram, sections, dynamic = None, set(), {}
+    modules, symbols = defaultdict(int), []
+
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    # Usage summary, listing the data sections
+    in_data = False
+    for line in lines:
+        match = HEADER.match(line)
+        if match:
+            ram, in_data = int(match.group(2), 16), True
+            continue
+        if in_data:
+            if line.strip().startswith('Total data memory used'):
+                in_data = False
+            elif USAGE.match(line):
+                sections.add(USAGE.match(line).group(1))
+        match = DYNAMIC.match(line)
+        if match:
+            dynamic[match.group(1)] = int(match.group(2))
+
+    # Memory map, attributing input sections to object files
+    section, pending, current = None, None, None
+    for line in lines:
+        match = OUTPUT.match(line)
+        if match:
+            section = match.group(1)
+            current = None
+            continue
+        data = section in sections if sections else \
+                                        bool(DATA_SECTIONS.match(section or ''))
+        if not data:
+            continue
+
+        match = INPUT.match(line)
+        if match and (match.group(1) or pending):
+            size = int(match.group(3), 16)
+            if size:
+                name    = module_name(match.group(4).strip())
+                current = [name, int(match.group(2), 16), size, []]
+                modules[name] += size
+                symbols.append(current)
+            pending = None
+        elif re.match(r'^ \S+\s*$', line):
+            pending = line.strip()      # name too long, numbers wrap
+        else:
+            match = SYMBOL.match(line)
+            if match and current is not None:
+                current[3].append((int(match.group(1), 16), match.group(2)))
+
+    for name in ('heap', 'stack'):
+        if name in dynamic:
+            modules['(' + name + ')'] += dynamic[name]
+
+    # Symbols span up to the next one in their input section
+    sized = []
+    for name, start, size, syms in symbols:
+        syms.sort()
+        for i, (addr, sym) in enumerate(syms):
+            end = syms[i + 1][0] if i + 1 < len(syms) else start + size
+            sized.append((end - addr, name, sym))
+
+    return ram, modules, sized
+
+
+def report(path, symbols=0):
+    ram, modules, sized = parse(path)
+    total = sum(modules.values())
+
+    print('RAM use by module, ' + path)
+    print('  %-24s %6s %6s' % ('module', 'bytes', '%'))
+    for name, size in sorted(modules.items(), key=lambda m: -m[1]):
+        print('  %-24s %6d %5.1f%%' % (name, size, 100. * size / total))
+    if ram:
+        print('  %-24s %6d of %d (%.1f%%)' % ('total', total, ram, \
+                                                        100. * total / ram))
+    else:
+        print('  %-24s %6d' % ('total', total))
+
+    if symbols:
+        print('Largest symbols')
+        for size, name, sym in sorted(sized, reverse=True)[:symbols]:
+            print('  %-24s %6d  %s' % (sym.lstrip('_'), size, name))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('maps', nargs='*', help='XC16 linker map files')
+    parser.add_argument('--symbols', type=int, default=0,
+                        help='also lists this many of the largest symbols')
+    a = parser.parse_args()
+
+    if not a.maps:
+        print('W: No map file to report RAM use from')
+    for path in a.maps:
+        report(path, a.symbols)
+
+
+if __name__ == '__main__':
+    main()
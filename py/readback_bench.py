@@ -0,0 +1,158 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Benchmark the readback and decode path over an emulated radio link
+#
+# Records a run on an emulated board (link_emu.Board) and reads it back
+# with sensor_dump.py's own readback code, under a few link conditions. For
+# each, it reports samples per second (from the read request to decoded
+# samples), packets per sample (including re-reads), the fraction of samples
+# recovered and how much of its sending time the board waited on the flash.
+#
+#   python readback_bench.py --samples 500 --speedup 4
+#
+# Exits with an error if a run over a lossless link does not come back
+# complete, so readback changes can be checked against it.
+#
+
+import sys, time, argparse
+import numpy as np
+from imageproc_py import utils
+import layout, link_emu, sensor_dump as sd
+from layout import CMD
+
+
+# (name, loss, reorder, latency [s])
+SCENARIOS = [
+    ('lossless',          0.,    0.,   0.),
+    ('latency 20ms',      0.,    0.,   .02),
+    ('loss 1%',           .01,   0.,   0.),
+    ('loss 5%',           .05,   0.,   0.),
+    ('reorder 2%',        0.,    .02,  0.),
+    ('loss 5%, reorder',  .05,   .02,  .02),
+]
+
+
+def bench(a, loss, reorder, latency):
+
+    board = link_emu.Board(read_time=a.read_time, seed=a.seed)
+    wrl   = link_emu.Link(board, sd.received, a.baud, loss, reorder, \
+                            latency, a.speedup, a.seed)
+
+    # The module globals sensor_dump.main() would otherwise set up
+    sd.p = utils.Bunch(dict(dest_addr_sd=b'\x11\x03', max_rereads=a.rereads,
+                            read_timeout=a.timeout / a.speedup))
+    sd.s = utils.Bunch(dict(pld_size=a.pld_size))
+    sd.d = utils.Bunch(dict(packet_cnt=0, dump=[], catalog={}, runs={}))
+    sd.rd = sd.d
+
+    wrl.send(sd.p.dest_addr_sd, 0, CMD.SET_ROW_GATE, \
+                                layout.pack('SetRowGateArgs', a.row_gate))
+    wrl.send(sd.p.dest_addr_sd, 0, CMD.SET_PIXEL_DEPTH, \
+        layout.pack('SetPixelDepthArgs', a.pixel_depth, a.compand, a.dither, 0))
+    wrl.send(sd.p.dest_addr_sd, 0, CMD.RECORD_SENSOR_DUMP, \
+        layout.pack('RecordSensorDumpArgs', int(time.time()), a.samples, 0, 0))
+
+    # The run is only as long as the rows the gate kept
+    sd.list_runs(wrl)
+    entry = sd.d.catalog[max(sd.d.catalog)]
+    count = int(entry['samples'])   # fewer than asked, if the flash filled
+    r     = utils.Bunch(sd.new_read(int(entry['pages']), count))
+
+    t = time.time()
+    sd.read_back(wrl, r, CMD.READ_MEMORY, \
+                layout.pack('ReadMemoryArgs', a.samples, a.pld_size))
+    t = (time.time() - t) * a.speedup
+    wrl.close()
+
+    ok = r.sample_cnt == count and np.array_equal(r.sample, board.recorded)
+    return dict(
+        pages           = r.pages,
+        samples_per_s   = r.sample_cnt / t,
+        pkts_per_sample = float(wrl.frames_sent) / max(1, count),
+        completion      = float(r.sample_cnt) / max(1, count),
+        bad_pages       = len(r.bad_pages),
+        flash_wait      = float(r.read_stats['flash_wait']) / \
+                                        max(1, r.read_stats['time']),
+        ack_fails       = int(r.read_stats['ack_fails']),
+        ok              = ok,
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--samples',   type=int,   default=300)
+    parser.add_argument('--pld-size',  type=int,   default=44,
+                        help='[bytes] per packet, must divide the page size')
+    parser.add_argument('--baud',      type=int,   default=230400)
+    parser.add_argument('--read-time', type=float, default=0.,
+                        help='[s] to read a page from flash')
+    parser.add_argument('--rereads',   type=int,   default=3)
+    parser.add_argument('--timeout',   type=float, default=.5,
+                        help='[s] without packets before a read is done, '
+                             'including re-reads')
+    parser.add_argument('--speedup',   type=float, default=1.,
+                        help='runs the emulated link this much faster')
+    parser.add_argument('--seed',      type=int,   default=1)
+    parser.add_argument('--row-gate',  type=int,   default=0,
+                        help='leaves out rows equal to the last one stored')
+    parser.add_argument('--pixel-depth', type=int, default=8,
+                        help='[bits] stored per pixel: 8, 6 or 4')
+    parser.add_argument('--compand',   type=int,   default=0,
+                        help='0: linear, 1: gamma, 2: log')
+    parser.add_argument('--dither',    type=int,   default=0,
+                        help='ordered dither when quantising')
+    a = parser.parse_args()
+
+    # Keep readback messages out of the report
+    stdout, sys.stdout = sys.stdout, open('/dev/null', 'w')
+    results = []
+    for name, loss, reorder, latency in SCENARIOS:
+        results.append((name, loss, bench(a, loss, reorder, latency)))
+    sys.stdout = stdout
+
+    print('%-18s %10s %12s %11s %6s %10s %11s %10s' % ('link', 'samples/s', \
+        'pkts/sample', 'completion', 'pages', 'bad pages', 'flash wait', \
+        'ack fails'))
+    failed = False
+    for name, loss, res in results:
+        print('%-18s %10.1f %12.2f %10.1f%% %6d %10d %10.1f%% %10d' % (name, \
+            res['samples_per_s'], res['pkts_per_sample'],              \
+            100 * res['completion'], res['pages'], res['bad_pages'],    \
+            100 * res['flash_wait'], res['ack_fails']))
+        if loss == 0. and not res['ok']:
+            print('E: ' + name + ' run did not come back intact')
+            failed = True
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+#
+# Check the on-board camera row correction against its numpy model
+#
+# Builds rowcorr.c through firmsim, calibrates it from dark and flat rows of a
+# synthetic camera with fixed-pattern noise and vignetting, then checks that
+# its portable pass matches layout.correct_rows bit for bit over random rows
+# and tables. Column non-uniformity of flat rows is reported before and after
+# correction, along with the cost of the pass on the host. Fails on any
+# mismatch, or if corrected flat rows still spread more than --tol.
+#
+# With a session, the table and the timings GET_ROW_CORR reported on board
+# are shown instead, in cycles per row for the DSP pass and the C one.
+#
+#   python rowcorr_bench.py --fpn 6 --vignetting .3
+#   python rowcorr_bench.py data/latest_session.shelf
+#
+
+import shelve, ctypes, time, argparse
+import numpy as np
+import firmsim, layout
+
+
+ROW_SIZE = layout.const.ROW_SIZE
+MIPS     = 40.      # [instructions/us] of the dsPIC, one cycle each
+
+
+class RowCorr(object):
+    '''rowcorr.c, fed with the rows of numpy arrays.'''
+
+    def __init__(self):
+        self.lib = firmsim.load('rowcorr')
+        self.lib.rowcorrSetup()
+        self.buf = (ctypes.c_ubyte * ROW_SIZE)()
+
+    def calibrate(self, phase, rows):
+        calib_sum = (ctypes.c_uint16 * ROW_SIZE)()
+        self.lib.rowcorrCalibStart(phase, calib_sum)
+        for row in rows:
+            self.set_buf(row)
+            self.lib.rowcorrCalibAddRow(calib_sum, self.buf)
+        self.lib.rowcorrCalibFinish(calib_sum)
+
+    def table(self):
+        return (np.array([self.lib.rowcorrGetOffset(i) \
+                                            for i in range(ROW_SIZE)]),
+                np.array([self.lib.rowcorrGetGain(i) \
+                                            for i in range(ROW_SIZE)]))
+
+    def set_table(self, offset, gain):
+        for i in range(ROW_SIZE):
+            self.lib.rowcorrSetColumn(i, int(offset[i]), int(gain[i]))
+
+    def apply(self, rows):
+        out = np.empty((len(rows), ROW_SIZE), np.uint8)
+        for i, row in enumerate(rows):
+            self.set_buf(row)
+            self.lib.rowcorrApplyC(self.buf)
+            out[i] = np.frombuffer(self.buf, np.uint8)
+        return out
+
+    def set_buf(self, row):
+        ctypes.memmove(self.buf, np.ascontiguousarray(row, np.uint8) \
+                                                    .ctypes.data, ROW_SIZE)
+
+
+def camera(a, rng):
+    '''Returns a function taking rows of a scene to rows as the camera sees
+    them, with per-column dark levels and responses.'''
+    dark = np.clip(a.dark + rng.normal(0, a.fpn, ROW_SIZE), 0, 255)
+    x    = np.linspace(-1, 1, ROW_SIZE)
+    resp = (1 - a.vignetting * x**2) * (1 + rng.normal(0, a.prnu, ROW_SIZE))
+
+    def sense(scene):
+        noisy = dark + resp * scene + rng.normal(0, a.noise, scene.shape)
+        return np.clip(np.round(noisy), 0, 255).astype(np.uint8)
+    return sense
+
+
+def non_uniformity(rows):
+    '''[pixel values] spread of the column means of flat rows.'''
+    return np.asarray(rows, np.float64).mean(axis=0).std()
+
+
+def bench(a):
+    rng   = np.random.RandomState(a.seed)
+    corr  = RowCorr()
+    sense = camera(a, rng)
+    shift = layout.const.ROW_CORR_GAIN_BITS
+
+    # Calibration, through the firmware
+    corr.calibrate(layout.const.ROW_CORR_DARK, \
+                            sense(np.zeros((a.rows, ROW_SIZE))))
+    corr.calibrate(layout.const.ROW_CORR_FLAT, \
+                            sense(np.full((a.rows, ROW_SIZE), a.level)))
+    offset, gain = corr.table()
+    print('I: Calibrated from %d rows each: offsets %d..%d, gains '       \
+          '%.3f..%.3f, flat level %.1f' % (a.rows, offset.min(),          \
+          offset.max(), gain.min() / 2.**shift, gain.max() / 2.**shift,   \
+          corr.lib.rowcorrCalibLevel() / 16.))
+
+    spread = []
+    for level in (a.level / 2., a.level):
+        flat = sense(np.full((a.rows, ROW_SIZE), level))
+        spread.append(non_uniformity(corr.apply(flat)))
+        print('I: Flat rows at %3.0f, column spread %.2f before, %.2f '  \
+              'after correction' % (level, non_uniformity(flat), spread[-1]))
+
+    # Bit exactness, over random rows with the calibrated and random tables
+    rows       = rng.randint(0, 256, (a.check, ROW_SIZE))
+    mismatched = np.sum(corr.apply(rows) != \
+                                layout.correct_rows(rows, offset, gain))
+    offset     = rng.randint(-64, 128, ROW_SIZE)
+    gain       = rng.randint(0, 0x8000, ROW_SIZE)
+    corr.set_table(offset, gain)
+    mismatched += np.sum(corr.apply(rows) != \
+                                layout.correct_rows(rows, offset, gain))
+    print('I: %d of %d pixels differ from the numpy model' % \
+                                        (mismatched, 2 * rows.size))
+
+    # Host cost, of the pass alone
+    t = time.time()
+    for i in range(a.check):
+        corr.lib.rowcorrApplyC(corr.buf)
+    t = time.time() - t
+    print('I: %.0f ns per row on host' % (1E9 * t / a.check))
+
+    checks = firmsim.Checks()
+    checks.check('Pixels differing from the model', mismatched, 0)
+    checks.check('Corrected column spread', max(spread), a.tol)
+    checks.exit()
+
+
+def on_board(a):
+    shelf = shelve.open(a.session, 'r')
+    d     = shelf['d']
+    shelf.close()
+
+    if getattr(d, 'row_corr', None) is None:
+        print('W: Session has no row correction from the board')
+        return
+    info  = d.row_corr['info']
+    rows  = max(1, int(info['bench_rows']))
+    gain  = d.row_corr['gain'] / 2.**layout.const.ROW_CORR_GAIN_BITS
+    print('I: Row correction %s, phases calibrated %d, offsets %d..%d, '  \
+          'gains %.3f..%.3f' % ('on' if info['enabled'] else 'off',       \
+          info['calibrated'], d.row_corr['offset'].min(),                 \
+          d.row_corr['offset'].max(), gain.min(), gain.max()))
+    print('I: On board, %.0f cycles per row (%.1f per pixel), %.0f in C '  \
+          '(%.1f per pixel), over %d rows' %                              \
+          (MIPS * info['bench_time'] / rows,                              \
+           MIPS * info['bench_time'] / rows / ROW_SIZE,                   \
+           MIPS * info['bench_time_c'] / rows,                            \
+           MIPS * info['bench_time_c'] / rows / ROW_SIZE, rows))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('session', nargs='?',
+                        help='shelf saved by sensor_dump.py')
+    parser.add_argument('--dark',       type=float, default=12.,
+                        help='[pixel values] mean dark level')
+    parser.add_argument('--fpn',        type=float, default=4.,
+                        help='[pixel values] spread of column dark levels')
+    parser.add_argument('--prnu',       type=float, default=.05,
+                        help='spread of column responses, relative')
+    parser.add_argument('--vignetting', type=float, default=.3,
+                        help='response lost at the row ends, relative')
+    parser.add_argument('--noise',      type=float, default=2.,
+                        help='[pixel values] per pixel')
+    parser.add_argument('--level',      type=float, default=180.,
+                        help='[pixel values] flat reference at the centre')
+    parser.add_argument('--rows',       type=int,   default=64,
+                        help='averaged per reference, up to 255')
+    parser.add_argument('--check',      type=int,   default=2000,
+                        help='random rows checked against the model')
+    parser.add_argument('--seed',       type=int,   default=1)
+    parser.add_argument('--tol',        type=float, default=1.,
+                        help='[pixel values] corrected column spread')
+    a = parser.parse_args()
+
+    if a.session:
+        on_board(a)
+    else:
+        bench(a)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Check the on-board sample spacing against its settings
+#
+# Builds sampleskip.c through firmsim and feeds it a quiet stretch, an
+# onset of motion and a quiet stretch again, once for each of the settings a
+# host can send with SET_SAMPLE_SKIP. Full-rate levels of 0 for both the
+# gyro and the Back-EMF, as well as a sample_skip_max of 1, must sample every
+# period. Otherwise the spacing must reach sample_skip_max while quiet and go
+# back to every period at once on the onset.
+#
+#   python sampleskip_check.py --skip-max 8
+#
+
+import ctypes, argparse
+import numpy as np
+import firmsim, layout
+
+
+BIAS_SHIFT = layout.const.GYRO_BIAS_FRAC_BITS
+
+
+class Spacer(object):
+    '''sampleskip.c, over a run of gyro and Back-EMF samples.'''
+
+    def __init__(self):
+        self.lib  = firmsim.load('sampleskip')
+        self.gyro = (ctypes.c_int16 * 3)()
+        self.bias = (ctypes.c_int16 * 3)()
+
+    def run(self, skip_max, gyro_full, bemf_full, gyro, bemf, bias):
+        self.lib.sampleskipSetup(skip_max, gyro_full, bemf_full)
+        for i in range(3):
+            self.bias[i] = bias[i] << BIAS_SHIFT
+        skips = []
+        for g, b in zip(gyro, bemf):
+            for i in range(3):
+                self.gyro[i] = int(g[i])
+            skips.append(self.lib.sampleskipNext(self.gyro, self.bias, \
+                                                                    int(b)))
+        return np.array(skips)
+
+
+def test_run(a):
+    '''Gyro counts about a bias and Back-EMF, quiet then moving then quiet,
+    and the index of the onset.'''
+    rng   = np.random.RandomState(a.seed)
+    n     = 3 * a.quiet
+    bias  = (12, -30, 7)
+    gyro  = np.array(bias) + rng.randint(-2, 3, (n, 3))
+    bemf  = 400 + rng.randint(-2, 3, n)
+    onset = a.quiet
+    gyro[onset:2 * a.quiet] += 2 * a.gyro_full
+    bemf[onset:2 * a.quiet:2] += 2 * a.bemf_full
+    return gyro, bemf, bias, onset
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--skip-max',  type=int, default=8)
+    parser.add_argument('--gyro-full', type=int, default=200,
+                        help='[counts] gyro magnitude for full rate')
+    parser.add_argument('--bemf-full', type=int, default=100,
+                        help='[counts] Back-EMF change for full rate')
+    parser.add_argument('--quiet',     type=int, default=100,
+                        help='[samples] in each quiet stretch')
+    parser.add_argument('--seed',      type=int, default=1)
+    a = parser.parse_args()
+
+    spacer = Spacer()
+    gyro, bemf, bias, onset = test_run(a)
+    checks = firmsim.Checks()
+
+    cases = (('gyro and Back-EMF', a.skip_max, a.gyro_full, a.bemf_full),
+             ('gyro only',         a.skip_max, a.gyro_full, 0),
+             ('Back-EMF only',     a.skip_max, 0,           a.bemf_full),
+             ('no measure',        a.skip_max, 0,           0),
+             ('skip_max of 1',     1,          a.gyro_full, a.bemf_full))
+
+    print('          settings | quiet  onset  mean skip')
+    for name, skip_max, gyro_full, bemf_full in cases:
+        skips = spacer.run(skip_max, gyro_full, bemf_full, gyro, bemf, bias)
+        quiet = skips[onset - 1]
+        print('%18s | %5d  %5d  %9.2f' % \
+                        (name, quiet, skips[onset], np.mean(skips)))
+
+        if gyro_full == 0 and bemf_full == 0 or skip_max == 1:
+            checks.check('Periods skipped, ' + name, np.max(skips) - 1, 0)
+        else:
+            checks.check('Quiet spacing short of skip_max, ' + name, \
+                                                    skip_max - quiet, 0)
+            checks.check('Onset not at full rate, ' + name, \
+                                                    skips[onset] - 1, 0)
+            checks.check('Spacing out of bounds, ' + name, \
+                        int(np.any((skips < 1) | (skips > skip_max))), 0)
+    checks.exit()
+
+
+if __name__ == '__main__':
+    main()
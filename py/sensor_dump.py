@@ -49,11 +49,13 @@
 import sys, os, time, traceback, logging as lg, argparse, shelve, pickle
 import struct as st, numpy as np
 from imageproc_py import radio, payload, utils
+import layout, clocksync
+from layout import CMD
 
 
 def main():
 
-    global p, s, d, do_save_vicon_stream
+    global p, s, d, rd, clock, do_save_vicon_stream
 
     # Parse command line arguments
     parser = argparse.ArgumentParser()
@@ -92,7 +94,7 @@ def main():
     #wrl.setSrcAddr(p.src_addr)
 
     print('I: Resetting sensor capture board...')
-    wrl.send(p.dest_addr_sd, 0, p.cmd_reset)
+    wrl.send(p.dest_addr_sd, 0, CMD.RESET)
     time.sleep(3)
 
     # Capture settings
@@ -105,34 +107,51 @@ def main():
     settings['sample_motor_on']  = 0
     settings['sample_motor_off'] = 0
     settings['vicon_samples']    = 0
+    settings['pages']            = 0
+    settings['gyro_bias_conf']   = 0
+    settings['pld_size']         = 44 # [bytes] must divide the page size
 
     s = utils.Bunch(settings)
 
     print('I: Getting capture settings...')
-    wrl.send(p.dest_addr_sd, 0, p.cmd_get_settings)
+    wrl.send(p.dest_addr_sd, 0, CMD.GET_SETTINGS)
     time.sleep(1)
 
     s.samples          = int(p.t * p.t_factor / s.sampling_period)
     s.sample_motor_on  = int(p.motor_on  * s.samples)
     s.sample_motor_off = int(p.motor_off * s.samples)
     s.vicon_samples    = int(p.t * p.vicon_percent * p.vicon_fs)
+    s.attitude_log     = p.attitude_log if p.attitude_period else 0
+    s.pages            = layout.max_run_pages(s.samples, p.pixel_depth, \
+                                                            s.attitude_log)
+
+    # Runs stop early rather than overflow the flash, and sizing them for the
+    # worst case, every row stored, tells when that could happen
+    free_pages = layout.const.MEM_PAGE_COUNT - s.mem_page_start
+    if s.pages > free_pages:
+        print('W: ' + str(s.samples) + ' samples may not fit in flash, ' + \
+              'only the first ' + str(layout.max_run_samples(free_pages, \
+                                    p.pixel_depth, s.attitude_log)) + \
+              ' are sure to')
 
     # Data
     data = {}
 
     data['packet_cnt'] = 0
-    data['sample_cnt'] = 0
-
-    data['id']         = np.zeros((s.samples,   1), dtype=np.uint16)
-    data['bemf_ts']    = np.zeros((s.samples,   1), dtype=np.uint32)
-    data['bemf']       = np.zeros((s.samples,   1), dtype=np.uint16)
-    data['gyro_ts']    = np.zeros((s.samples,   1), dtype=np.uint32)
-    data['gyro_calib'] = np.zeros(             (3), dtype=np.float32)
-    data['gyro']       = np.zeros((s.samples,   3), dtype=np.int16)
-    data['row_ts']     = np.zeros((s.samples,   1), dtype=np.uint32)
-    data['row_num']    = np.zeros((s.samples,   1), dtype=np.uint8)
-    data['row_valid']  = np.zeros((s.samples,   1), dtype=np.uint8)
-    data['row']        = np.zeros((s.samples, 152), dtype=np.uint8)
+
+    data['gyro_calib'] = np.zeros(3, dtype=np.float32)
+    data['catalog']    = {}    # runs in flash, by index
+    data['runs']       = {}    # runs read back from the catalog, by index
+    data['clock']      = None  # board to host time mapping, see clocksync
+    data['steer_stats'] = None # board side latency of flow steering
+    data['run_summary'] = None # board side statistics of the last run
+    data['row_corr']    = None # board side column correction of camera rows
+    data['sequence']    = None # progress of the sequence run on board
+    data['profile_length'] = None # motor profile points held on board
+    data['profile_dropped'] = 0   # of the last chunk sent, out of order
+    data['sweep_summaries'] = [] # of the runs it recorded, in order
+
+    data.update(new_read(s.pages, s.samples))
 
     if p.do_stream_vicon:
 
@@ -144,7 +163,8 @@ def main():
 
     data['dump'] = []
 
-    d = utils.Bunch(data)
+    d  = utils.Bunch(data)
+    rd = d  # readback in progress
 
     if p.do_stream_vicon:
 
@@ -203,20 +223,98 @@ def main():
         # Zero hall-effect motor counts
         wrl.send(p.dest_addr_vr, 0, cmd.ZERO_POS, 'Zero Motor Counts')
 
+    # Keep track of the board clock, so its samples can be mapped to host time
+    clock = clocksync.ClockSync(wrl, p.dest_addr_sd, p.time_sync_period)
+    clock.start()
+
+    list_runs(wrl)
+    if len(d.catalog) >= layout.const.CATALOG_MAX_RUNS:
+        print('W: Run catalog is full, the board will not record.')
+
     if p.do_capture_sensors:
 
-        print('I: Running gyro calibration...')
-        wrl.send(p.dest_addr_sd, 0, p.cmd_calibrate_gyro)
-        time.sleep(2)
+        clock.pause() # the board blocks while calibrating and erasing
 
-        print('I: Erasing memory contents...')
-        wrl.send(p.dest_addr_sd, 0, p.cmd_erase_memory, st.pack('<H', s.samples))
-        time.sleep(p.t * 2)
+        # The board tracks the gyro bias while stationary, so back-to-back
+        # runs can do without the blocking calibration
+        if s.gyro_bias_conf >= p.gyro_bias_conf:
+            print('I: Skipping gyro calibration, bias estimated over ' + \
+                                    str(s.gyro_bias_conf) + ' windows.')
+            d.gyro_calib = np.float32(s.gyro_bias) / \
+                                    2**layout.const.GYRO_BIAS_FRAC_BITS
+        else:
+            print('I: Running gyro calibration...')
+            wrl.send(p.dest_addr_sd, 0, CMD.CALIBRATE_GYRO)
+            time.sleep(2)
+
+        # Rows take less flash when packed, which erasing accounts for
+        print('I: Setting pixel depth...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_PIXEL_DEPTH,                   \
+            layout.pack('SetPixelDepthArgs', p.pixel_depth,               \
+                                    p.pixel_compand, p.pixel_dither, 0))
+
+        # Attitude is integrated between samples as well, at the gyro's rate
+        print('I: Setting attitude integration...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_ATTITUDE,                      \
+            layout.pack('SetAttitudeArgs', p.attitude_period,             \
+                                                    s.attitude_log, 0))
+
+        # References are taken before the run, the table is kept in RAM
+        if p.row_corr_calib:
+            calibrate_rows(wrl, p.row_corr_calib)
+        print('I: Setting camera row correction...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_ROW_CORR, \
+                        layout.pack('SetRowCorrArgs', p.row_corr, 0))
+        if p.row_corr:
+            get_row_corr(wrl)
+
+        # Sweeps erase ahead of each of their runs, on board
+        if not p.sweep_duty_cycles:
+            print('I: Erasing memory contents...')
+            wrl.send(p.dest_addr_sd, 0, CMD.ERASE_MEMORY, \
+                                layout.pack('EraseMemoryArgs', s.samples))
+            time.sleep(p.t * 2)
 
         print('I: Setting desired motor duty cycle...')
-        wrl.send(p.dest_addr_sd, 0, p.cmd_set_motor_speed, \
-                                            st.pack('<f', p.motor_duty_cycle))
-
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_MOTOR_SPEED, \
+                        layout.pack('SetMotorSpeedArgs', p.motor_duty_cycle))
+
+        print('I: Setting motor speed controller...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_SPEED_CTRL,                  \
+            layout.pack('SetSpeedCtrlArgs', p.speed_setpoint, p.speed_kp, \
+                                            p.speed_ki, p.speed_ctrl, 0))
+
+        print('I: Uploading motor profile...')
+        if not upload_profile(wrl, p.motor_profile, p.speed_ctrl):
+            raise SystemExit('Motor profile did not reach the board, ' + \
+                                                            'not recording')
+
+        print('I: Setting flow steering...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_STEER_CTRL,                    \
+            layout.pack('SetSteerCtrlArgs', p.steer_kp, p.steer_kd,       \
+                                    p.steer_derot, p.steer_ctrl, 0))
+        s.steer_ctrl, s.steer_kp = int(p.steer_ctrl), p.steer_kp
+        s.steer_kd, s.steer_derot = p.steer_kd, p.steer_derot
+
+        print('I: Setting sample spacing...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_SAMPLE_SKIP,                   \
+            layout.pack('SetSampleSkipArgs', p.skip_gyro_full,            \
+                                    p.skip_bemf_full, p.sample_skip_max, 0))
+        s.sample_skip_max = p.sample_skip_max
+
+        print('I: Setting camera row gate...')
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_ROW_GATE, \
+                            layout.pack('SetRowGateArgs', p.row_gate))
+
+        print('I: Setting camera row schedule...')
+        row_mask = 32 * [0]
+        for row in p.row_sched_rows:
+            row_mask[row >> 3] |= 1 << (row & 0x7)
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_ROW_SCHEDULE,                \
+            layout.pack('SetRowScheduleArgs', p.row_sched_mode,          \
+                        p.row_sched_period, p.row_sched_phase, row_mask))
+
+        clock.resume()
         raw_input('\nQ: To start the run, please [PRESS ENTER]')
         if p.do_capture_optitrack:
             raw_input('\nQ: Please turn back on optitrack recording ' + \
@@ -227,20 +325,90 @@ def main():
             print('I: Commanding motion...')
         time.sleep(.5 * p.t)
         do_save_vicon_stream = True
-        print('I: Requesting a sensor dump into memory...')
-        wrl.send(p.dest_addr_sd, 0, p.cmd_record_sensor_dump, \
-            st.pack('<3H', s.samples, s.sample_motor_on, s.sample_motor_off))
-        time.sleep(p.t + 1)
-
-    # TODO (fgb) : Why not get an ACK that triggers this?
-    raw_input('\nQ: To request a memory dump, please [PRESS ENTER]')
-    do_save_vicon_stream = False
-    print('I: Requesting memory contents...')
-    wrl.send(p.dest_addr_sd, 0, p.cmd_read_memory, st.pack('<2H', s.samples, 44))
-    raw_input('\nQ: When data has been received, please [PRESS ENTER]')
-    print('I: Received ' + str(d.sample_cnt) + ' samples (' + \
+        if p.sweep_duty_cycles:
+            print('I: Running the sweep on board...')
+            clock.pause()
+            sweep_runs = run_sweep(wrl)
+            clock.resume()
+        else:
+            print('I: Requesting a sensor dump into memory...')
+            clock.pause()
+            wrl.send(p.dest_addr_sd, 0, CMD.RECORD_SENSOR_DUMP,          \
+                layout.pack('RecordSensorDumpArgs', int(time.time()),    \
+                        s.samples, s.sample_motor_on, s.sample_motor_off))
+            time.sleep(p.t + 1)
+            clock.resume()
+
+            if p.steer_ctrl:
+                get_steer_stats(wrl)
+
+            # Worth a look before spending minutes reading the run back
+            get_run_summary(wrl)
+
+    if p.do_read_memory:
+        # TODO (fgb) : Why not get an ACK that triggers this?
+        raw_input('\nQ: To request a memory dump, please [PRESS ENTER]')
+        do_save_vicon_stream = False
+        print('I: Requesting memory contents...')
+        clock.pause()
+        # Rows left out make runs shorter than s.pages, as the catalog tells
+        list_runs(wrl)
+        if d.catalog:
+            latest = d.catalog[max(d.catalog)]
+            d.update(new_read(int(latest['pages']), int(latest['samples'])))
+        read_back(wrl, d, CMD.READ_MEMORY, \
+                    layout.pack('ReadMemoryArgs', s.samples, s.pld_size))
+        clock.resume()
+        print('I: Received ' + str(d.sample_cnt) + ' samples (' + \
                                             str(d.packet_cnt) + ' packets)')
 
+    # Runs of a sweep are read back as earlier ones, but for the latest
+    if p.do_capture_sensors and p.sweep_duty_cycles:
+        p.runs = list(p.runs) + \
+                        (sweep_runs[:-1] if p.do_read_memory else sweep_runs)
+
+    # Runs recorded earlier, possibly over several sessions
+    if p.runs:
+        clock.pause()
+        list_runs(wrl)
+    for run in p.runs:
+        if run not in d.catalog:
+            print('E: Run ' + str(run) + ' is not in the catalog')
+            continue
+        entry = d.catalog[run]
+        print('I: Requesting run ' + str(run) + '...')
+        r = utils.Bunch(new_read(int(entry['pages']), int(entry['samples'])))
+        r.entry = entry
+        read_back(wrl, r, CMD.READ_RUN, \
+                    layout.pack('ReadRunArgs', run, s.pld_size))
+        print('I: Received ' + str(r.sample_cnt) + ' samples of run ' + \
+                                                                str(run))
+        d.runs[run] = r
+
+    if p.do_clear_catalog:
+        print('I: Clearing the run catalog...')
+        wrl.send(p.dest_addr_sd, 0, CMD.CLEAR_CATALOG)
+
+    # Board times of this session's run, mapped to host (and Vicon) time
+    clock.stop()
+    d.clock = clock.fit()
+    if d.clock is None:
+        print('W: Board clock could not be synced, no TIME_SYNC answers')
+    else:
+        print('I: Board clock synced from %d exchanges: offset %.6f s, ' \
+              'drift %.1f ppm, min rtt %.1f ms' % (d.clock['used'],      \
+              d.clock['offset'], d.clock['drift'], 1E3 * d.clock['rtt_min']))
+        if p.do_capture_sensors and d.sample is not None:
+            sample = d.sample[:d.sample_cnt]
+            d.host_start_time = clocksync.to_host(d.clock, \
+                                                    d.header['start_time'])
+            d.gyro_host_ts = clocksync.to_host(d.clock, sample['gyro_ts'])
+            d.bemf_host_ts = clocksync.to_host(d.clock, sample['bemf_ts'])
+            # Samples without a row have a row_ts of 0, which reads as a wrap
+            d.row_host_ts  = clocksync.to_host(d.clock, np.where(         \
+                sample['row_valid'] == layout.const.ROW_NONE, np.nan,    \
+                                                    sample['row_ts']))
+
     # Shelve session information
     datafile_shelf = datafile + '_session.shelf'
     shelf       = shelve.open(datafile_shelf)
@@ -267,59 +435,179 @@ def main():
                     ' (symlink at ' + os.path.basename(latest_symlink) + ')')
 
 
-def received(packet):
+def upload_sequence(wrl, steps, chunk=4):
 
-    global p, s, d
+    # Always send the first chunk, as it clears the previous sequence
+    for first in range(0, max(len(steps), 1), chunk):
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_SEQUENCE,                   \
+            layout.pack('SetSequenceArgs', first,                       \
+                        len(steps[first:first + chunk])) +              \
+                                    b''.join(steps[first:first + chunk]))
 
-    pld        = payload.Payload(packet.get('rf_data'))
-    pkt_status = pld.status
-    pkt_type   = pld.type
-    pkt_data   = pld.data
 
-    if ( pkt_type == p.cmd_read_memory ):
+def run_sweep(wrl):
+    '''Records sweep_repeats runs at each of sweep_duty_cycles, on board,
+    without the host in the loop. Returns the catalog indices of the runs.'''
 
-        # TODO (fgb) : Ensure packets received are contiguously saved!!!
-        cnt = d.sample_cnt
+    global p, s, d
 
-        if cnt < s.samples:
+    const    = layout.const
+    pack     = layout.pack
+    step     = layout.pack_step
+    run_args = pack('RecordSensorDumpArgs', 0, s.samples,              \
+                                    s.sample_motor_on, s.sample_motor_off)
+
+    # Per duty cycle: set it, then erase, record, summarize and wait for
+    # every repeat. Runs get the host time they start at, from the board's
+    steps = []
+    for duty_cycle in p.sweep_duty_cycles:
+        steps.append(step(CMD.SET_MOTOR_SPEED, \
+                                    pack('SetMotorSpeedArgs', duty_cycle)))
+        first  = len(steps)
+        steps += [step(CMD.ERASE_MEMORY, pack('EraseMemoryArgs', s.samples)),
+                  step(CMD.RECORD_SENSOR_DUMP, run_args),
+                  step(CMD.GET_RUN_SUMMARY),
+                  step(const.SEQ_WAIT, \
+                        pack('SeqWaitArgs', int(1000 * p.sweep_delay)))]
+        if p.sweep_repeats > 1:
+            steps.append(step(const.SEQ_REPEAT, \
+                        pack('SeqRepeatArgs', first, p.sweep_repeats - 1)))
+
+    runs = len(p.sweep_duty_cycles) * max(1, p.sweep_repeats)
+    if len(steps) > const.SEQ_MAX_STEPS:
+        print('E: Sweep takes ' + str(len(steps)) + ' steps, the board ' + \
+                        'holds ' + str(const.SEQ_MAX_STEPS) + ', not run')
+        return []
+    if runs > const.CATALOG_MAX_RUNS - len(d.catalog):
+        print('W: Catalog has room for ' + str(const.CATALOG_MAX_RUNS - \
+                len(d.catalog)) + ' of the ' + str(runs) + ' runs')
+
+    list_runs(wrl)
+    cataloged = set(d.catalog)
+    upload_sequence(wrl, steps)
+    d.sequence, d.sweep_summaries = None, []
+    wrl.send(p.dest_addr_sd, 0, CMD.RUN_SEQUENCE, \
+                        pack('RunSequenceArgs', int(time.time()), 1, 0))
+
+    # Steps report as they start, erasing and recording being the longest
+    timeout = p.t * 3 + p.sweep_delay + p.read_timeout
+    t_last, last = time.time(), None
+    while d.sequence is None or d.sequence['state'] == const.SEQ_RUNNING:
+        if d.sequence is not last:
+            t_last, last = time.time(), d.sequence
+        if time.time() - t_last > timeout:
+            print('W: Sweep went quiet, stopping it')
+            wrl.send(p.dest_addr_sd, 0, CMD.RUN_SEQUENCE, \
+                                        pack('RunSequenceArgs', 0, 0, 0))
+            time.sleep(1)
+            break
+        time.sleep(.01)
+
+    for i, summary in enumerate(d.sweep_summaries):
+        duty_cycle = p.sweep_duty_cycles[min(i // max(1, p.sweep_repeats), \
+                                            len(p.sweep_duty_cycles) - 1)]
+        print('I: Sweep run ' + str(i) + ', at ' + str(duty_cycle) + '%')
+        for line in check_run_summary(summary, s.sample_motor_on <       \
+                        min(s.samples, s.sample_motor_off) and           \
+                        (duty_cycle > 0 or p.speed_ctrl), p.stall_bemf_span):
+            print(line)
+
+    list_runs(wrl)
+    return sorted(set(d.catalog) - cataloged)
+
+
+def sequence_progress(progress):
+    '''Line describing a SequenceProgressRecord.'''
+    const, state = layout.const, progress['state']
+    if state == const.SEQ_RUNNING:
+        return 'I: Sequence step %d started, command %d, %d steps so far' % \
+                (progress['step'], progress['cmd'], progress['executed'])
+    if state == const.SEQ_DONE:
+        return 'I: Sequence done after %d steps' % progress['executed']
+    if state == const.SEQ_STOPPED:
+        return 'W: Sequence stopped after %d steps' % progress['executed']
+    if state == const.SEQ_FAILED:
+        return 'E: Sequence cannot run, step %d (command %d) is not valid' % \
+                                            (progress['step'], progress['cmd'])
+    return 'W: Sequence in unknown state ' + str(state)
+
+
+def upload_profile(wrl, profile, speed_ctrl, chunk=8):
+
+    # Thrust is a back-EMF setpoint under speed control, else a duty cycle
+    pdc    = lambda percent: int(percent / 100. * layout.const.MOTOR_PDC_MAX)
+    points = [layout.pack('ProfilePointRecord', int(1000 * t),          \
+                    thrust if speed_ctrl else pdc(thrust), pdc(steer))  \
+                                            for t, thrust, steer in profile]
+
+    # The board interpolates forward in time, so it drops points that are not
+    times = [t for t, thrust, steer in profile]
+    if any(t1 <= t0 for t0, t1 in zip(times, times[1:])):
+        print('E: Motor profile times must increase from point to point')
+        return False
+
+    # Always send the first chunk, as it clears the previous profile
+    d.profile_length  = None
+    d.profile_dropped = 0
+    for first in range(0, max(len(points), 1), chunk):
+        wrl.send(p.dest_addr_sd, 0, CMD.SET_PROFILE,                    \
+            layout.pack('SetProfileArgs', first,                        \
+                        len(points[first:first + chunk])) +             \
+                                    b''.join(points[first:first + chunk]))
+
+    # Every chunk is answered with the length so far, the last one counts
+    t_sent = time.time()
+    while d.profile_length != len(points) and \
+                                    time.time() - t_sent < p.read_timeout:
+        time.sleep(.01)
+    if d.profile_length != len(points):
+        print('E: Board holds ' + str(d.profile_length) + ' of the ' + \
+                                str(len(points)) + ' motor profile points, ' + \
+                    str(d.profile_dropped) + ' dropped from the last chunk')
+        return False
+    return True
 
-            if pkt_status != (d.packet_cnt % 256):
-                print('W: Received packet status (' + str(pkt_status) + \
-                ') does not match expectations (' + str(d.packet_cnt%256) + ')')
 
-            pkt_index = pkt_status % 4
+def received(packet):
 
-            if pkt_index == 0:
+    global p, s, d, rd, clock
 
-                d.id[cnt]        = st.unpack('<H',   pkt_data[:2]   )
-                d.bemf_ts[cnt]   = st.unpack('<L',   pkt_data[2:6]  )
-                d.bemf[cnt]      = st.unpack('<H',   pkt_data[6:8]  )
-                d.gyro_ts[cnt]   = st.unpack('<L',   pkt_data[8:12] )
-                d.gyro[cnt]      = st.unpack('<3h',  pkt_data[12:18])
-                d.row_ts[cnt]    = st.unpack('<L',   pkt_data[18:22])
-                d.row_num[cnt]   = st.unpack('<B',   pkt_data[22:23])
-                d.row_valid[cnt] = st.unpack('<B',   pkt_data[23:24])
-                d.row[cnt,:20]   = st.unpack('<20B', pkt_data[24:]  )
+    pld        = payload.Payload(packet.get('rf_data'))
+    pkt_status = pld.status
+    pkt_type   = pld.type
+    pkt_data   = pld.data
 
-                if cnt != d.id[cnt]:
-                    print( str(cnt) + ' - ' + str(d.id[cnt]) )
-                    #print('W: Received sample id (' + str(d.id[cnt][0]) + \
-                    #        ') does not match sample count (' + str(cnt) + ')')
+    if ( pkt_type in (CMD.READ_MEMORY, CMD.READ_RUN, CMD.READ_PAGES) ):
+
+        # Packets carry a running count, locating them despite any losses,
+        # while those that fall behind it were merely reordered
+        delta = (pkt_status - rd.read_cnt) % 256
+        if delta < 128:
+            index = rd.read_cnt + delta
+            if delta:
+                print('W: Lost ' + str(delta) + ' packets before packet ' + \
+                                                                    str(index))
+            rd.read_cnt = index + 1
+        else:
+            index = rd.read_cnt + delta - 256
 
-            elif pkt_index == 1:
+        # The basestation reports the signal strength of every frame
+        rssi = packet.get('rssi')
+        rd.rx_log.append((time.time(), index, ord(rssi[:1]) if rssi else 0))
 
-                d.row[cnt,20:64] = st.unpack('<44B', pkt_data)
+        pkts = layout.const.MEM_PAGE_SIZE // s.pld_size
 
-            elif pkt_index == 2:
+        if 0 <= index < len(rd.read_plan) * pkts:
 
-                d.row[cnt,64:108]= st.unpack('<44B', pkt_data)
+            page   = rd.read_plan[index // pkts]
+            offset = page * layout.const.MEM_PAGE_SIZE + \
+                                                (index % pkts) * s.pld_size
 
-            else:
+            rd.raw[offset:offset + len(pkt_data)] = pkt_data
+            rd.pkt_ok[page * pkts + index % pkts] = True
 
-                d.row[cnt,108:]  = st.unpack('<44B', pkt_data)
-                d.sample_cnt    += 1
-                if d.sample_cnt == s.samples:
-                    print('I: All packets were received.')
+            if index == len(rd.read_plan) * pkts - 1:
+                print('I: Last requested packet was received.')
 
         else:
             print('W: Extra packet received! Appending to data dump.')
@@ -328,18 +616,446 @@ def received(packet):
 
         d.packet_cnt += 1
 
-    elif ( pkt_type == p.cmd_get_settings ):
-        s.sampling_period  = st.unpack('<H', pkt_data[:2])[0]
-        s.mem_page_start   = st.unpack('<H', pkt_data[2:4])[0]
-        s.motor_duty_cycle = st.unpack('<f', pkt_data[4:])[0]
-    elif ( pkt_type == p.cmd_calibrate_gyro ):
-        d.gyro_calib = st.unpack('<3f', pkt_data)
+    elif ( pkt_type == CMD.GET_SETTINGS ):
+        layout.unpack_into(s, 'SettingsRecord', pkt_data)
+    elif ( pkt_type == CMD.SET_PROFILE ):
+        reply = layout.unpack('ProfileLengthRecord', pkt_data)
+        d.profile_length  = int(reply['length'])
+        d.profile_dropped = int(reply['dropped'])
+    elif ( pkt_type == CMD.TIME_SYNC ):
+        clock.received(pkt_data)
+    elif ( pkt_type == CMD.GET_READ_STATS and pkt_status == 0 ):
+        rd.read_stats = layout.unpack('ReadStatsRecord', pkt_data)
+    elif ( pkt_type == CMD.GET_READ_STATS ):
+        rd.read_slices[pkt_status - 1] = \
+                                layout.unpack('ReadSliceRecord', pkt_data)
+        rd.slice_cnt += 1
+    elif ( pkt_type == CMD.GET_STEER_STATS ):
+        d.steer_stats = layout.unpack('SteerStatsRecord', pkt_data)
+    elif ( pkt_type == CMD.GET_RUN_SUMMARY ):
+        d.run_summary = layout.unpack('RunSummaryRecord', pkt_data)
+        if d.sequence is not None and \
+                            d.sequence['state'] == layout.const.SEQ_RUNNING:
+            d.sweep_summaries.append(d.run_summary)
+    elif ( pkt_type == CMD.RUN_SEQUENCE ):
+        d.sequence = layout.unpack('SequenceProgressRecord', pkt_data)
+        print(sequence_progress(d.sequence))
+    elif ( pkt_type == CMD.GET_ROW_CORR and pkt_status == 0 ):
+        d.row_corr = {'info': layout.unpack('RowCorrInfoRecord', pkt_data),
+            'offset': np.zeros(layout.const.ROW_SIZE, dtype=np.int16),
+            'gain':   np.zeros(layout.const.ROW_SIZE, dtype=np.int16),
+            'chunks': 0}
+    elif ( pkt_type == CMD.GET_ROW_CORR and d.row_corr is not None ):
+        chunk = layout.unpack('RowCorrChunkRecord', pkt_data)
+        first = int(chunk['first'])
+        size  = len(d.row_corr['offset'][first:first + \
+                                        layout.const.ROW_CORR_CHUNK])
+        d.row_corr['offset'][first:first + size] = chunk['offset'][:size]
+        d.row_corr['gain'][first:first + size]   = chunk['gain'][:size]
+        d.row_corr['chunks'] += 1
+    elif ( pkt_type == CMD.LIST_RUNS ):
+        d.catalog[pkt_status] = layout.unpack('RunEntryRecord', pkt_data)
+    elif ( pkt_type == CMD.CALIBRATE_GYRO ):
+        d.gyro_calib = layout.unpack('GyroCalibRecord', pkt_data)['offset']
     else:
         print('E: Invalid packet received! Appending to data dump.')
         d.dump.append([pkt_status, pkt_type, pkt_data])
         print([pkt_status, pkt_type, pkt_data])
 
 
+def new_read(pages, samples):
+
+    global s
+
+    # Readback state of a run, filled in by received()
+    return dict(
+        pages      = pages,
+        samples    = samples,
+        raw        = bytearray(pages * layout.const.MEM_PAGE_SIZE),
+        pkt_ok     = np.zeros(pages * layout.const.MEM_PAGE_SIZE // s.pld_size,
+                                                                 dtype=bool),
+        read_plan  = [],    # pages requested, in order of transmission
+        read_cnt   = 0,     # packets expected so far from read_plan
+        bad_pages  = [],    # pages still missing or failing their CRC
+        header     = None,  # decoded from raw once readback is done
+        sample     = None,
+        sample_cnt = 0,
+        read_stats = None,  # board side timing of the readback
+        read_slices = np.zeros(layout.const.READ_SLICES,
+                               dtype=layout.dtypes['ReadSliceRecord']),
+        slice_cnt  = 0,
+        rx_log     = [],    # (host time, packet index, RSSI [-dBm]) per frame
+        link       = None,  # summary and timeline of both sides of the link
+        grid       = None,  # [us] full-rate times, if the rate adapted
+        uniform    = None,  # samples interpolated onto grid
+    )
+
+
+def read_back(wrl, r, cmd_type, args):
+
+    global p, rd
+
+    rd = r
+    r.read_plan, r.read_cnt = list(range(r.pages)), 0
+    wrl.send(p.dest_addr_sd, 0, cmd_type, args)
+    wait_for_read(r)
+
+    r.bad_pages = check_pages(r)
+    for attempt in range(p.max_rereads):
+        if not r.bad_pages:
+            break
+        print('W: Pages failing verification: ' + str(r.bad_pages))
+        print('I: Requesting ' + str(len(r.bad_pages)) + ' pages again...')
+        request_pages(wrl, r, r.bad_pages)
+        wait_for_read(r)
+        r.bad_pages = check_pages(r)
+    if r.bad_pages:
+        print('E: Pages failing verification: ' + str(r.bad_pages))
+
+    get_read_stats(wrl, r)
+    decode_samples(r)
+
+
+def wait_for_read(r):
+
+    global p, s
+
+    # Done once every planned packet is accounted for, or the board goes quiet
+    pkts     = layout.const.MEM_PAGE_SIZE // s.pld_size
+    read_cnt = -1
+    while read_cnt < len(r.read_plan) * pkts:
+        if r.read_cnt != read_cnt:
+            read_cnt, t_last = r.read_cnt, time.time()
+        elif time.time() - t_last > p.read_timeout:
+            break
+        time.sleep(.1)
+
+
+def get_read_stats(wrl, r):
+
+    global p
+
+    # Tells whether the board kept the link busy, or had it wait on the flash
+    wrl.send(p.dest_addr_sd, 0, CMD.GET_READ_STATS)
+    t_sent = time.time()
+    while (r.read_stats is None or r.slice_cnt < layout.const.READ_SLICES) \
+                                and time.time() - t_sent < p.read_timeout:
+        time.sleep(.01)
+    if r.read_stats is None:
+        print('W: No readback stats received')
+        return
+
+    stats = r.read_stats
+    time_ = max(1, stats['time'])
+    print('I: Board sent %d pages in %d packets over %.2f s, waiting '     \
+          '%.1f%% on the flash and %.1f%% on the radio' % (stats['pages'], \
+          stats['packets'], stats['time'] / 1E6,                           \
+          100. * stats['flash_wait'] / time_,                              \
+          100. * stats['radio_wait'] / time_))
+
+    r.link = link_summary(r)
+    board, host = r.link['board'], r.link['host']
+    print('I: Board TX queue held %.1f of %d packets on average, %d max, '  \
+          'with %d enqueue and %d packet request retries' %                \
+          (board['txq_mean'], stats['txq_size'], stats['txq_max'],         \
+           stats['enqueue_retries'], stats['request_retries']))
+    print('I: Board saw %d of %d packets unacknowledged (%.1f%%)' %         \
+          (stats['ack_fails'], stats['acks_checked'],                      \
+           100. * board['ack_fail_rate']))
+    if host['frames']:
+        print('I: Host received %d frames, RSSI -%.0f dBm median, '         \
+              '-%.0f dBm worst, longest gap %.0f ms' % (host['frames'],    \
+              host['rssi_median'], host['rssi_worst'], 1E3 * host['gap_max']))
+
+
+def link_summary(r):
+    '''Both sides of the readback link: board totals, host reception, and a
+    timeline of both over the READ_SLICES slices of the pages read.'''
+
+    global s
+
+    stats  = r.read_stats
+    slices = r.read_slices
+    pkts   = max(1, int(stats['packets']))
+    board  = dict((field, int(stats[field])) for field in stats.dtype.names)
+    board.update(
+        txq_mean      = float(stats['txq_sum']) / pkts,
+        ack_fail_rate = float(stats['ack_fails']) / \
+                                        max(1, int(stats['acks_checked'])),
+        retries_per_packet = float(stats['enqueue_retries']) / pkts)
+
+    log  = np.array(r.rx_log, dtype=[('t', 'f8'), ('index', 'i4'),
+                                     ('rssi', 'u1')]).reshape(-1)
+    gaps = np.diff(log['t']) if log.size > 1 else np.zeros(1)
+    host = dict(
+        frames      = int(log.size),
+        rssi_median = float(np.median(log['rssi'])) if log.size else 0.,
+        rssi_worst  = int(log['rssi'].max()) if log.size else 0,
+        gap_max     = float(gaps.max()))
+
+    # Frames go in the slice of their page, as the board places them
+    pkts      = layout.const.MEM_PAGE_SIZE // s.pld_size
+    plan      = np.array(r.read_plan + [r.pages - 1], dtype=int)
+    page      = plan[np.clip(log['index'] // pkts, 0, len(plan) - 1)]
+    slice_of  = np.clip(page * layout.const.READ_SLICES // max(1, r.pages), \
+                                    0, layout.const.READ_SLICES - 1)
+    received  = np.bincount(slice_of, minlength=layout.const.READ_SLICES)
+    rssi_sum  = np.bincount(slice_of, log['rssi'].astype(float), \
+                                    layout.const.READ_SLICES)
+    timeline  = dict(
+        time            = slices['time'] / 1E6,
+        packets         = slices['packets'],
+        enqueue_retries = slices['enqueue_retries'],
+        ack_fails       = slices['ack_fails'],
+        txq_mean        = slices['txq_sum'] / \
+                                    np.maximum(1., slices['packets']),
+        received        = received,
+        rssi_mean       = rssi_sum / np.maximum(1, received))
+
+    return dict(board=board, host=host, timeline=timeline)
+
+
+def get_steer_stats(wrl):
+
+    global p, d
+
+    # Latency is from the capture of the row completing a frame to the PWM
+    # update, split into waiting for that row to be handled and computing
+    d.steer_stats = None
+    wrl.send(p.dest_addr_sd, 0, CMD.GET_STEER_STATS)
+    time.sleep(1)
+    if d.steer_stats is None:
+        print('W: No steering stats received')
+        return
+
+    stats = d.steer_stats
+    print('I: Board steered %d times, latency %.2f ms mean, %.2f ms max, '  \
+          'of which %.2f ms max detecting and %.2f ms max computing' %     \
+          (stats['steps'], stats['latency_sum'] / 1E3 /                    \
+           max(1, stats['steps']), stats['latency_max'] / 1E3,             \
+           stats['detect_max'] / 1E3, stats['compute_max'] / 1E3))
+
+
+def get_run_summary(wrl):
+
+    global p, s, d
+
+    d.run_summary = None
+    wrl.send(p.dest_addr_sd, 0, CMD.GET_RUN_SUMMARY)
+    t_sent = time.time()
+    while d.run_summary is None and time.time() - t_sent < p.read_timeout:
+        time.sleep(.01)
+    if d.run_summary is None:
+        print('W: No run summary received')
+        return
+
+    for line in check_run_summary(d.run_summary, s.sample_motor_on < \
+                        min(s.samples, s.sample_motor_off) and             \
+                        (p.motor_duty_cycle > 0 or p.speed_ctrl),          \
+                        p.stall_bemf_span):
+        print(line)
+
+
+def calibrate_rows(wrl, rows):
+
+    global p, d
+
+    # Each phase answers with the table, as GET_ROW_CORR does
+    for phase, prompt in ((layout.const.ROW_CORR_DARK, 'cover the lens'),
+                          (layout.const.ROW_CORR_FLAT, 'light the camera ' + \
+                                        'evenly, e.g. through white paper')):
+        raw_input('\nQ: For the row correction, please ' + prompt + \
+                                                            ' [PRESS ENTER]')
+        d.row_corr = None
+        wrl.send(p.dest_addr_sd, 0, CMD.CALIBRATE_ROWS, \
+                layout.pack('CalibrateRowsArgs', phase, min(rows, 255)))
+        if not wait_for_row_corr(p.read_timeout + 2): # rows take up to 2 s
+            print('W: No answer to the row correction calibration')
+            return
+        info = d.row_corr['info']
+        print('I: Averaged %d rows for the %s reference' % \
+                (info['rows'], 'dark' if phase == layout.const.ROW_CORR_DARK \
+                                                                else 'flat'))
+
+    info = d.row_corr['info']
+    gain = d.row_corr['gain'].astype(np.float64) / \
+                                        2**layout.const.ROW_CORR_GAIN_BITS
+    print('I: Flat level %.1f above dark, offsets %d..%d, gains %.2f..%.2f' \
+          % (info['level'] / 16., d.row_corr['offset'].min(),             \
+             d.row_corr['offset'].max(), gain.min(), gain.max()))
+
+
+def get_row_corr(wrl):
+
+    global p, d
+
+    d.row_corr = None
+    wrl.send(p.dest_addr_sd, 0, CMD.GET_ROW_CORR)
+    if not wait_for_row_corr(p.read_timeout):
+        print('W: No row correction received')
+        return
+
+    # Cycles at 40 MIPS, timed on board over the same row for both passes
+    info = d.row_corr['info']
+    rows = max(1, int(info['bench_rows']))
+    print('I: Row correction %s, phases calibrated %d, %.0f cycles per '  \
+          'row (%.0f in C)' % ('on' if info['enabled'] else 'off',        \
+          info['calibrated'], 40. * info['bench_time'] / rows,            \
+          40. * info['bench_time_c'] / rows))
+
+
+def wait_for_row_corr(timeout):
+
+    global d
+
+    chunks = -(-layout.const.ROW_SIZE // layout.const.ROW_CORR_CHUNK)
+    t_sent = time.time()
+    while (d.row_corr is None or d.row_corr['chunks'] < chunks) and \
+                                    time.time() - t_sent < timeout:
+        time.sleep(.01)
+    return d.row_corr is not None and d.row_corr['chunks'] >= chunks
+
+
+def check_run_summary(summary, motor_on, stall_bemf_span):
+    '''Lines describing a run summary, warning about what makes the run look
+    bad: no rows, a saturated gyro, a stalled motor, or falling behind.'''
+
+    stats   = summary
+    samples = max(1, int(stats['samples']))
+    rows    = [100. * stats[field] / samples for field in \
+                        ('rows_stored', 'rows_unchanged', 'rows_none')]
+    ramp    = ' .:-=+*#%@'
+    thumb   = ''.join(ramp[int(v) * len(ramp) // 256] for v in stats['thumb'])
+    lines   = [
+        'I: Run took %d samples over %d sampling periods, rows %.0f%% '   \
+        'stored, %.0f%% unchanged, %.0f%% missing' %                      \
+                        ((stats['samples'], stats['slots']) + tuple(rows)),
+        'I: Gyro x %d..%d (%d), y %d..%d (%d), z %d..%d (%d) counts' %    \
+            tuple(int(stats[f][i]) for i in range(3) for f in             \
+                                ('gyro_min', 'gyro_max', 'gyro_mean')),
+        'I: Back-EMF %d..%d (%d) ADC counts' % (stats['bemf_min'],        \
+                                    stats['bemf_max'], stats['bemf_mean']),
+        'I: Row intensity over the run |%s|' % thumb,
+    ]
+
+    if stats['samples'] == 0:
+        lines.append('W: Run took no samples')
+    if rows[2] >= 100:
+        lines.append('W: Camera produced no rows')
+    if stats['gyro_saturated']:
+        lines.append('W: Gyro saturated in %d samples' % \
+                                                    stats['gyro_saturated'])
+    if motor_on and int(stats['bemf_max']) - int(stats['bemf_min']) < \
+                                                        stall_bemf_span:
+        lines.append('W: Back-EMF barely moved, the motor may have stalled')
+    if stats['late'] or stats['row_overruns']:
+        lines.append('W: Recorder fell behind: %d samples over a period '  \
+                     'late (%.1f ms max), %d rows lost to a full buffer' % \
+                     (stats['late'], stats['late_max'] / 1E3,              \
+                      stats['row_overruns']))
+    return lines
+
+
+def list_runs(wrl):
+
+    global p, d
+
+    d.catalog = {}
+    wrl.send(p.dest_addr_sd, 0, CMD.LIST_RUNS)
+    time.sleep(1)
+
+    for run in sorted(d.catalog):
+        entry = d.catalog[run]
+        print('I: Run %2d: %s, %5d samples at page %4d, %4d pages, '   \
+              '%5d rows unchanged' %                                   \
+            (run, time.strftime('%Y.%m.%d_%H.%M.%S',                  \
+                                time.localtime(entry['timestamp'])),   \
+             entry['samples'], entry['start_page'], entry['pages'],    \
+             entry['rows_unchanged']))
+
+
+def request_pages(wrl, r, pages):
+
+    global s
+
+    # The board keeps counting packets across requests, so extend the plan
+    for first, count in layout.page_runs(pages):
+        r.read_plan += list(range(first, first + count))
+        wrl.send(p.dest_addr_sd, 0, CMD.READ_PAGES, \
+                    layout.pack('ReadPagesArgs', first, count, s.pld_size))
+
+
+def check_pages(r):
+
+    global s
+
+    pkts    = layout.const.MEM_PAGE_SIZE // s.pld_size
+    missing = np.flatnonzero(~r.pkt_ok.reshape(r.pages, pkts).all(axis=1))
+    corrupt = layout.verify_pages(r.raw, r.pages)
+
+    return sorted(set(missing.tolist()) | set(corrupt.tolist()))
+
+
+def decode_samples(r):
+
+    # Records are stored back to back once the page CRCs are stripped, and
+    # only up to the first page that failed verification can be trusted
+    length = (r.bad_pages[0] if r.bad_pages else r.pages) * \
+                                            layout.const.MEM_PAGE_DATA_SIZE
+    r.header, r.sample, r.sample_cnt = layout.decode_run( \
+                        layout.page_data(r.raw, r.pages), r.samples, length)
+
+    if r.header['sample_size'] != layout.dtypes['SampleRecord'].itemsize or \
+            r.header['row_size'] != layout.row_size(r.header['pixel_depth']):
+        print('W: Run header does not match the record layout')
+
+    # Requested samples are at full rate, but quiet stretches may have been
+    # sampled several periods apart, so the run stands for more of them
+    skip_max = int(r.header['sample_skip_max'])
+    if skip_max > 1 and r.sample_cnt:
+        r.grid, r.uniform = layout.resample_run(r.header, r.sample, \
+                                                            r.sample_cnt)
+        print('I: Run took %d samples for %d at full rate (%.1f%%)' % \
+                (r.sample_cnt, r.grid.size, 100. * r.sample_cnt / r.grid.size))
+        if r.grid.size + skip_max <= r.header['samples']:
+            print('W: Run covers ' + str(r.grid.size) + ' of the ' + \
+                str(r.header['samples']) + ' sampling periods requested')
+    elif r.sample_cnt < r.header['samples']:
+        print('W: Run holds ' + str(r.sample_cnt) + ' of the ' + \
+                            str(r.header['samples']) + ' samples requested')
+
+    # Bias the board estimated online, as it stood at the start of the run
+    r.gyro_bias = np.float32(r.header['gyro_bias']) / \
+                                    2**layout.const.GYRO_BIAS_FRAC_BITS
+
+    for field in r.sample.dtype.names:
+        setattr(r, field, r.sample[field])
+
+    # Attitude integrated on board, as (w, x, y, z) quaternions
+    if r.header['attitude_log']:
+        r.quat = layout.attitude_quat(r.sample, r.sample_cnt)
+
+    mismatch = np.flatnonzero(r.id[:r.sample_cnt] != \
+                                    (np.arange(r.sample_cnt) & 0xFFFF))
+    if mismatch.size:
+        print('W: ' + str(mismatch.size) + ' sample ids do not match ' + \
+                            'their position, first at ' + str(mismatch[0]))
+
+    # How much the row gate saved, against storing every captured row
+    valid    = r.row_valid[:r.sample_cnt]
+    stored   = np.sum(valid == layout.const.ROW_STORED)
+    gated    = np.sum(valid == layout.const.ROW_UNCHANGED)
+    r.gating = dict(rows_stored = int(stored), rows_unchanged = int(gated),
+                    ratio = float(gated) / max(1, stored + gated),
+                    pages = r.pages,
+                    pages_ungated = layout.max_run_pages(r.samples, \
+                            r.header['pixel_depth'], r.header['attitude_log']))
+    if gated:
+        print('I: Row gate left out %d of %d rows (%.1f%%), %d pages '  \
+              'instead of up to %d' % (gated, stored + gated,           \
+              100 * r.gating['ratio'], r.pages, r.gating['pages_ungated']))
+
+
 def vicon_callback(packet_v):
 
     global s, d, do_save_vicon_stream
@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2013, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# - Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# - Neither the name of the University of California, Berkeley nor the names
+#   of its contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Simulate the back-EMF speed controller against a simple motor model
+#
+# Runs the firmware's fixed-point controller (speedctrl.c, built through
+# firmsim) at the PWM rate against a first-order DC motor model, for a few
+# battery voltages, and compares it with open-loop control tuned for the
+# nominal voltage. Gains are Q8.8, as sent with CMD_SET_SPEED_CTRL. Fails
+# if closed-loop control ends further than --tol from the setpoint.
+#
+
+import argparse
+import firmsim
+
+
+PDC_MAX = 2 * 624   # duty cycle register range, for 1KHz PWM at MIPS == 40
+DT      = 1E-3      # [s] controller runs at the PWM rate
+
+
+def motor(v_batt, tau, k_bemf):
+    '''First-order motor, returning back-EMF [ADC counts] per PWM period.'''
+    state = {'bemf' : 0.}
+    def step(pdc):
+        target = k_bemf * v_batt * float(pdc) / PDC_MAX
+        state['bemf'] += (target - state['bemf']) * DT / tau
+        return int(round(state['bemf']))
+    return step
+
+def run(ctrl, a, v_batt, closed_loop):
+    step = motor(v_batt, a.tau, a.k_bemf)
+    pdc  = int(PDC_MAX * a.setpoint / (a.k_bemf * a.v_nominal))
+    ctrl.speedctrlSetup(PDC_MAX)
+    ctrl.speedctrlSetGains(a.kp, a.ki)
+    ctrl.speedctrlSetSetpoint(a.setpoint)
+
+    bemf, settled = 0, None
+    for k in range(int(a.t / DT)):
+        if closed_loop:
+            pdc = ctrl.speedctrlUpdate(bemf)
+        bemf = step(pdc)
+        if abs(bemf - a.setpoint) > a.band * a.setpoint:
+            settled = None
+        elif settled is None:
+            settled = k * DT
+    return bemf, settled, pdc
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--setpoint',  type=int,   default=500)
+    parser.add_argument('--kp',        type=int,   default=256)
+    parser.add_argument('--ki',        type=int,   default=32)
+    parser.add_argument('--t',         type=float, default=1.,  help='[s]')
+    parser.add_argument('--tau',       type=float, default=.03, help='[s]')
+    parser.add_argument('--k_bemf',    type=float, default=200.,
+                                                help='[counts/V] at full duty')
+    parser.add_argument('--v_nominal', type=float, default=3.7, help='[V]')
+    parser.add_argument('--band',      type=float, default=.02,
+                                                help='settling band [%/100]')
+    parser.add_argument('--tol',       type=float, default=.02,
+                                    help='closed-loop error at the end [%/100]')
+    a = parser.parse_args()
+
+    ctrl   = firmsim.load('speedctrl')
+    checks = firmsim.Checks()
+    errors = []
+
+    print('  V_batt | open-loop bemf | closed-loop bemf   settled   pdc')
+    for v_batt in [3.4, 3.7, 4.2]:
+        ol, _, _          = run(ctrl, a, v_batt, False)
+        cl, settled, pdc  = run(ctrl, a, v_batt, True)
+        print('  %4.2f V | %14d | %16d   %s   %4d' % (v_batt, ol, cl,
+            ('%5.0f ms' % (1E3 * settled)) if settled is not None \
+                                                        else '   never', pdc))
+        errors.append((v_batt, abs(cl - a.setpoint) / float(a.setpoint)))
+
+    for v_batt, error in errors:
+        checks.check('Closed-loop error at %.2f V' % v_batt, error, a.tol)
+    checks.exit()
+
+
+if __name__ == '__main__':
+    main()
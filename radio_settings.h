@@ -14,7 +14,9 @@
 #define DEST_ADDR       0x1101
 #define SRC_ADDR        0x1103
 
-#define TXPQ_MAX_SIZE   40
+// Two DataFlash pages of 44 B readback packets, so that the next page is read
+// while the last goes out. Queued packets live on the heap (heap-size).
+#define TXPQ_MAX_SIZE   24
 #define RXPQ_MAX_SIZE   10
 
 
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Per-column offset and gain correction of camera rows
+ */
+
+#include "rowcorr.h"
+
+#include <string.h>
+
+
+// =========== Static Variables ===============================================
+static unsigned char enabled = 0;
+
+// (offset, gain) per column, interleaved as rowcorr_dsp.s walks them
+static int table[2 * ROW_SIZE];
+
+static unsigned char calib_rows, calib_phase, calib_done;
+static unsigned int  calib_level;
+
+// =========== Function Stubs =================================================
+#ifdef __XC16__
+extern void rowcorrApplyDsp(unsigned char *pixels, int *table,
+                            unsigned int count);
+#endif
+
+// =========== Public Functions ===============================================
+
+void rowcorrSetup(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ROW_SIZE; i++ )
+    {
+        rowcorrSetColumn(i, 0, ROWCORR_GAIN_ONE);
+    }
+
+    enabled     = 0;
+    calib_rows  = 0;
+    calib_phase = ROW_CORR_DARK;
+    calib_done  = 0;
+    calib_level = 0;
+}
+
+void rowcorrEnable(unsigned char new_enabled)
+{
+    enabled = new_enabled;
+}
+
+unsigned char rowcorrIsEnabled(void)
+{
+    return enabled;
+}
+
+void rowcorrCalibStart(unsigned char phase, unsigned int *calib_sum)
+{
+    memset ( calib_sum, 0, ROW_SIZE * sizeof(unsigned int) );
+    calib_rows  = 0;
+    calib_phase = phase;
+}
+
+void rowcorrCalibAddRow(unsigned int *calib_sum, unsigned char *pixels)
+{
+    unsigned int i;
+
+    if ( calib_rows == 0xFF ) return;
+
+    for ( i = 0; i < ROW_SIZE; i++ ) calib_sum[i] += pixels[i];
+    calib_rows++;
+}
+
+void rowcorrCalibFinish(unsigned int *calib_sum)
+{
+    unsigned int i;
+    long total = 0, level, response, gain;
+
+    if ( calib_rows == 0 ) return;
+
+    if ( calib_phase == ROW_CORR_DARK )
+    {
+        for ( i = 0; i < ROW_SIZE; i++ )
+        {
+            table[2 * i] = (calib_sum[i] + (calib_rows >> 1)) / calib_rows;
+        }
+    } else {
+        // Responses in Q4, less the dark level, against their mean
+        for ( i = 0; i < ROW_SIZE; i++ )
+        {
+            total += ((long) calib_sum[i] << 4) / calib_rows -
+                                                ((long) table[2 * i] << 4);
+        }
+        level = total / ROW_SIZE;
+        calib_level = (level > 0) ? (unsigned int) level : 0;
+
+        for ( i = 0; i < ROW_SIZE; i++ )
+        {
+            response = ((long) calib_sum[i] << 4) / calib_rows -
+                                                ((long) table[2 * i] << 4);
+            if ( response <= 0 || level <= 0 )
+            {
+                gain = ROWCORR_GAIN_ONE;    // Dead column, left as is
+            } else {
+                gain = ((level << ROWCORR_GAIN_SHIFT) + (response >> 1)) /
+                                                                    response;
+                if ( gain > ROWCORR_GAIN_MAX ) gain = ROWCORR_GAIN_MAX;
+            }
+            table[2 * i + 1] = (int) gain;
+        }
+    }
+
+    calib_done |= 1 << calib_phase;
+}
+
+unsigned char rowcorrCalibRows(void)
+{
+    return calib_rows;
+}
+
+unsigned char rowcorrCalibPhase(void)
+{
+    return calib_phase;
+}
+
+unsigned char rowcorrCalibDone(void)
+{
+    return calib_done;
+}
+
+unsigned int rowcorrCalibLevel(void)
+{
+    return calib_level;
+}
+
+void rowcorrApply(unsigned char *pixels)
+{
+#ifdef __XC16__
+    rowcorrApplyDsp(pixels, table, ROW_SIZE);
+#else
+    rowcorrApplyC(pixels);
+#endif
+}
+
+void rowcorrApplyC(unsigned char *pixels)
+{
+    unsigned int i;
+    long value;
+
+    for ( i = 0; i < ROW_SIZE; i++ )
+    {
+        value = ((long) ((int) pixels[i] - table[2 * i]) * table[2 * i + 1] +
+                    (1 << (ROWCORR_GAIN_SHIFT - 1))) >> ROWCORR_GAIN_SHIFT;
+        pixels[i] = (value < 0) ? 0 : ((value > 255) ? 255 : value);
+    }
+}
+
+int rowcorrGetOffset(unsigned int column)
+{
+    return (column < ROW_SIZE) ? table[2 * column] : 0;
+}
+
+int rowcorrGetGain(unsigned int column)
+{
+    return (column < ROW_SIZE) ? table[2 * column + 1] : ROWCORR_GAIN_ONE;
+}
+
+void rowcorrSetColumn(unsigned int column, int offset, int gain)
+{
+    if ( column >= ROW_SIZE ) return;
+
+    table[2 * column]     = offset;
+    table[2 * column + 1] = gain;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Per-column offset and gain correction of camera rows
+ */
+
+#ifndef __ROWCORR_H
+#define __ROWCORR_H
+
+
+#include "layout.h"
+
+// Each pixel becomes (pixel - offset) * gain, clamped to 0..255.
+#define ROWCORR_GAIN_SHIFT      ROW_CORR_GAIN_BITS
+#define ROWCORR_GAIN_ONE        (1 << ROWCORR_GAIN_SHIFT)
+#define ROWCORR_GAIN_MAX        (0x7FFF)    // just under 8
+
+
+// Identity table, not applied.
+void rowcorrSetup(void);
+
+void rowcorrEnable(unsigned char enabled);
+
+unsigned char rowcorrIsEnabled(void);
+
+// Calibration: start a phase, ROW_CORR_DARK or ROW_CORR_FLAT, add up to 255
+// rows taken as is, then finish it to update the table. Dark rows set the
+// offsets, flat ones the gains against them. The caller holds the ROW_SIZE
+// column sums for the duration, e.g. on its stack.
+void rowcorrCalibStart(unsigned char phase, unsigned int *calib_sum);
+
+void rowcorrCalibAddRow(unsigned int *calib_sum, unsigned char *pixels);
+
+void rowcorrCalibFinish(unsigned int *calib_sum);
+
+// Rows and phase of the last calibration, phases done as a bit per phase,
+// and the mean flat response [pixel values] Q4, less the offsets.
+unsigned char rowcorrCalibRows(void);
+unsigned char rowcorrCalibPhase(void);
+unsigned char rowcorrCalibDone(void);
+unsigned int rowcorrCalibLevel(void);
+
+// Corrects ROW_SIZE pixels in place, rowcorr_dsp.s on the dsPIC.
+void rowcorrApply(unsigned char *pixels);
+void rowcorrApplyC(unsigned char *pixels);
+
+int rowcorrGetOffset(unsigned int column);
+int rowcorrGetGain(unsigned int column);
+void rowcorrSetColumn(unsigned int column, int offset, int gain);
+
+
+#endif // __ROWCORR_H
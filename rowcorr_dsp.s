@@ -0,0 +1,80 @@
+;
+; Copyright (c) 2013, Regents of the University of California
+; All rights reserved.
+;
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+;
+; - Redistributions of source code must retain the above copyright notice,
+;   this list of conditions and the following disclaimer.
+; - Redistributions in binary form must reproduce the above copyright notice,
+;   this list of conditions and the following disclaimer in the documentation
+;   and/or other materials provided with the distribution.
+; - Neither the name of the University of California, Berkeley nor the names
+;   of its contributors may be used to endorse or promote products derived
+;   from this software without specific prior written permission.
+;
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+; ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+; LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+; CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+; SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+; INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+; CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+; ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+; POSSIBILITY OF SUCH DAMAGE.
+;
+;
+; DSP pass of the per-column row correction, see rowcorr.h
+;
+
+        .include "xc.inc"
+
+        .global _rowcorrApplyDsp
+
+        .section .text
+
+; void rowcorrApplyDsp(unsigned char *pixels, int *table, unsigned int count)
+;
+;   w0: pixels, corrected in place
+;   w1: (offset, gain) per column
+;   w2: columns
+;
+; Matches rowcorrApplyC() bit for bit, for gains with ROWCORR_GAIN_SHIFT of
+; 12. The difference to the offset is taken to Q15 by a shift of 7, so that
+; the accumulator, with the rounding term preloaded and shifted left by 3,
+; holds the corrected pixel in Q7 in its upper word. Writing it back
+; saturates to 0x7FFF, i.e. 255 once shifted down, and negatives are
+; cleared. About 14 cycles per pixel.
+
+_rowcorrApplyDsp:
+        cp0     w2
+        bra     z, 2f
+
+        push    CORCON
+        bclr    CORCON, #IF             ; fractional multiplies
+        bset    CORCON, #SATDW          ; saturated accumulator writes
+        mov     #8, w6                  ; rounding term, 2^11 << 8 in A
+
+1:
+        ze      [w0], w4
+        sub     w4, [w1++], w4          ; pixel - offset
+        sl      w4, #7, w4
+        mov     [w1++], w5              ; gain
+        lac     w6, A
+        mac     w4*w5, A
+        sac     A, #-3, w4              ; Q7, saturated
+        btsc    w4, #15
+        clr     w4                      ; below the offset
+        lsr     w4, #7, w4
+        mov.b   w4, [w0++]
+        dec     w2, w2
+        bra     nz, 1b
+
+        pop     CORCON
+2:
+        return
+
+        .end
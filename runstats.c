@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Running statistics of a run, for a quick look at it
+ */
+
+#include "runstats.h"
+
+#include <string.h>
+
+
+// =========== Static Variables ===============================================
+static RunSummaryRecord summary;
+static unsigned long run_slots;                 // requested
+static unsigned long period;                    // [us] sampling
+static long long gyro_sum[3];                   // long runs overflow a long
+static unsigned long bemf_sum;
+static unsigned long thumb_sum[RUN_THUMB_SIZE]; // of row pixel sums
+static unsigned int  thumb_rows[RUN_THUMB_SIZE];
+
+// =========== Function Stubs =================================================
+static unsigned char thumbBin(unsigned long slot);
+
+// =========== Public Functions ===============================================
+
+void runstatsReset(unsigned long slots, unsigned long sampling_period)
+{
+    unsigned char i;
+
+    memset ( summary.contents, 0, sizeof(summary) );
+    for ( i = 0; i < 3; i++ )
+    {
+        summary.gyro_min[i] = 0x7FFF;
+        summary.gyro_max[i] = -0x7FFF - 1;
+        gyro_sum[i] = 0;
+    }
+    summary.bemf_min = 0xFFFF;
+    bemf_sum = 0;
+
+    memset ( thumb_sum, 0, sizeof(thumb_sum) );
+    memset ( thumb_rows, 0, sizeof(thumb_rows) );
+    run_slots = (slots > 0) ? slots : 1;
+    period    = sampling_period;
+}
+
+void runstatsAddSample(SampleRecord *sample, unsigned long late)
+{
+    unsigned char i, saturated = 0;
+    int g;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        g = sample->gyro[i];
+        if ( g < summary.gyro_min[i] ) summary.gyro_min[i] = g;
+        if ( g > summary.gyro_max[i] ) summary.gyro_max[i] = g;
+        if ( g >= RUNSTATS_GYRO_FULL || g <= -RUNSTATS_GYRO_FULL )
+        {
+            saturated = 1;
+        }
+        gyro_sum[i] += g;
+    }
+    if ( saturated && summary.gyro_saturated < 0xFFFF )
+    {
+        summary.gyro_saturated++;
+    }
+
+    if ( sample->bemf < summary.bemf_min ) summary.bemf_min = sample->bemf;
+    if ( sample->bemf > summary.bemf_max ) summary.bemf_max = sample->bemf;
+    bemf_sum += sample->bemf;
+
+    switch ( sample->row_valid )
+    {
+        case ROW_STORED:    summary.rows_stored++;    break;
+        case ROW_UNCHANGED: summary.rows_unchanged++; break;
+        default:            summary.rows_none++;      break;
+    }
+
+    if ( late > summary.late_max ) summary.late_max = late;
+    if ( late >= period && summary.late < 0xFFFF )
+    {
+        summary.late++;
+    }
+
+    summary.samples++;
+}
+
+void runstatsAddRow(unsigned char *pixels, unsigned long slot)
+{
+    unsigned char bin = thumbBin(slot);
+    unsigned int i, sum = 0;
+
+    // ROW_SIZE pixels of at most 255 still fit in an unsigned int
+    for ( i = 0; i < ROW_SIZE; i++ ) sum += pixels[i];
+
+    thumb_sum[bin] += sum;
+    if ( thumb_rows[bin] < 0xFFFF ) thumb_rows[bin]++;
+}
+
+void runstatsFinish(unsigned long slots, unsigned int row_overruns)
+{
+    unsigned char i;
+    long long n = summary.samples;
+
+    summary.slots        = slots;
+    summary.row_overruns = row_overruns;
+
+    if ( n > 0 )
+    {
+        for ( i = 0; i < 3; i++ )
+        {
+            summary.gyro_mean[i] = (int) (gyro_sum[i] / n);
+        }
+        summary.bemf_mean = (unsigned int) (bemf_sum / n);
+    } else {
+        memset ( summary.gyro_min, 0, sizeof(summary.gyro_min) );
+        memset ( summary.gyro_max, 0, sizeof(summary.gyro_max) );
+        summary.bemf_min = 0;
+    }
+
+    for ( i = 0; i < RUN_THUMB_SIZE; i++ )
+    {
+        summary.thumb[i] = thumb_rows[i] ? (unsigned char)
+                (thumb_sum[i] / ((unsigned long) thumb_rows[i] * ROW_SIZE)) : 0;
+    }
+}
+
+RunSummaryRecord* runstatsGet(void)
+{
+    return &summary;
+}
+
+
+// =========== Private Functions ==============================================
+
+static unsigned char thumbBin(unsigned long slot)
+{
+    // Slots past the run, e.g. from the last skip, go in the last bin
+    if ( slot >= run_slots ) return RUN_THUMB_SIZE - 1;
+
+    return (unsigned char) (slot * RUN_THUMB_SIZE / run_slots);
+}
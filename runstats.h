@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Running statistics of a run, for a quick look at it
+ */
+
+#ifndef __RUNSTATS_H
+#define __RUNSTATS_H
+
+
+#include "layout.h"
+
+#define RUNSTATS_GYRO_FULL      (32767) // [counts] saturated at or above
+
+
+// Starts over, for a run of the given number of full-rate samples. Those
+// taken over a sampling period [us] late count as late.
+void runstatsReset(unsigned long slots, unsigned long sampling_period);
+
+// Feeds a sample as stored, taken late [us] after it was due.
+void runstatsAddSample(SampleRecord *sample, unsigned long late);
+
+// Feeds the pixels of a row captured in the given slot, before any packing.
+void runstatsAddRow(unsigned char *pixels, unsigned long slot);
+
+// Completes the summary once the run is over, with the rows the camera
+// buffer lost and the slots the samples covered.
+void runstatsFinish(unsigned long slots, unsigned int row_overruns);
+
+// Summary of the run last finished, or of the one so far.
+RunSummaryRecord* runstatsGet(void);
+
+
+#endif // __RUNSTATS_H
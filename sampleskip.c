@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Motion driven sample spacing
+ */
+
+#include "sampleskip.h"
+#include "gyrobias.h"
+
+
+// =========== Static Variables ===============================================
+static unsigned char skip_max  = 1;
+static unsigned int  gyro_full = 0;
+static unsigned int  bemf_full = 0;
+
+static unsigned int  held;              // activity, peak decaying
+static unsigned int  last_bemf;
+static unsigned char has_bemf;          // last_bemf is valid
+
+// =========== Function Stubs =================================================
+static unsigned int scaleLevel(unsigned long value, unsigned int full);
+
+// =========== Public Functions ===============================================
+
+void sampleskipSetup(unsigned char new_skip_max, unsigned int new_gyro_full,
+                     unsigned int new_bemf_full)
+{
+    skip_max  = (new_skip_max > 0) ? new_skip_max : 1;
+    gyro_full = new_gyro_full;
+    bemf_full = new_bemf_full;
+    sampleskipReset();
+}
+
+void sampleskipReset(void)
+{
+    held     = SAMPLESKIP_FULL;
+    has_bemf = 0;
+}
+
+unsigned char sampleskipNext(int *gyro, int *bias, unsigned int bemf)
+{
+    unsigned long magnitude = 0;
+    unsigned int  level, change;
+    unsigned char i;
+    int rate;
+
+    // With no measure of motion, nothing tells a quiet period apart
+    if ( skip_max == 1 || (gyro_full == 0 && bemf_full == 0) ) return 1;
+
+    // Sum of absolute rates, as it needs no multiplications
+    for ( i = 0; i < 3; i++ )
+    {
+        rate = gyro[i] - (bias[i] >> GYROBIAS_FRAC_BITS);
+        magnitude += (rate < 0) ? -(long) rate : rate;
+    }
+    level = scaleLevel(magnitude, gyro_full);
+
+    change = (bemf > last_bemf) ? bemf - last_bemf : last_bemf - bemf;
+    if ( has_bemf && scaleLevel(change, bemf_full) > level )
+    {
+        level = scaleLevel(change, bemf_full);
+    }
+    last_bemf = bemf;
+    has_bemf  = 1;
+
+    // Rounded up, so that the peak decays all the way to 0
+    held -= (held + (1 << SAMPLESKIP_DECAY_SHIFT) - 1)
+                                            >> SAMPLESKIP_DECAY_SHIFT;
+    if ( level > held ) held = level;
+
+    return skip_max - (unsigned char) (((unsigned long) (skip_max - 1) * held
+                                + SAMPLESKIP_FULL / 2) / SAMPLESKIP_FULL);
+}
+
+
+// =========== Private Functions ==============================================
+
+static unsigned int scaleLevel(unsigned long value, unsigned int full)
+{
+    if ( full == 0 ) return 0;
+    if ( value >= full ) return SAMPLESKIP_FULL;
+    return (unsigned int) ((value * SAMPLESKIP_FULL) / full);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Motion driven sample spacing
+ */
+
+#ifndef __SAMPLESKIP_H
+#define __SAMPLESKIP_H
+
+
+#define SAMPLESKIP_FULL         (256)
+#define SAMPLESKIP_DECAY_SHIFT  (4)
+
+
+// A skip_max of 1, or full-rate levels of 0 for both, sample every period.
+// A full-rate level of 0 leaves that measure out.
+void sampleskipSetup(unsigned char skip_max, unsigned int gyro_full,
+                     unsigned int bemf_full);
+
+// Starts over at full rate, e.g. when the motor is about to switch.
+void sampleskipReset(void);
+
+// Feeds a sample, with the gyro bias as kept by gyrobias, and returns the
+// periods to wait before the next one, from 1 to skip_max.
+unsigned char sampleskipNext(int *gyro, int *bias, unsigned int bemf);
+
+
+#endif // __SAMPLESKIP_H
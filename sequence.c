@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * On-board experiment sequencer
+ */
+
+#include "sequence.h"
+
+#include <string.h>
+
+
+// =========== Static Variables ===============================================
+static SequenceStepRecord steps[SEQ_MAX_STEPS];
+static unsigned int length;
+
+static SequenceProgressRecord progress;
+static unsigned int  cursor;                    // next step to go through
+static unsigned char remaining[SEQ_MAX_STEPS];  // repeats left, per step
+static unsigned char is_waiting;
+static unsigned long wait_start;                // [us]
+
+// =========== Function Stubs =================================================
+static unsigned char checkStep(unsigned int index);
+static void reloadRepeats(unsigned int first, unsigned int last);
+
+// =========== Public Functions ===============================================
+
+void sequenceSetup(void)
+{
+    sequenceClear();
+    memset ( progress.contents, 0, sizeof(progress) );
+}
+
+void sequenceClear(void)
+{
+    sequenceStop();
+    length = 0;
+}
+
+void sequenceSetStep(unsigned int index, SequenceStepRecord *step)
+{
+    if ( progress.state == SEQ_RUNNING ) return;
+    if ( index >= SEQ_MAX_STEPS || index > length ) return;
+
+    steps[index] = *step;
+    if ( index == length ) length++;
+}
+
+unsigned int sequenceGetLength(void)
+{
+    return length;
+}
+
+void sequenceStart(unsigned long now)
+{
+    unsigned int i;
+
+    memset ( progress.contents, 0, sizeof(progress) );
+    progress.time = now;
+    cursor        = 0;
+    is_waiting    = 0;
+
+    for ( i = 0; i < length; i++ )
+    {
+        if ( !checkStep(i) )
+        {
+            progress.state = SEQ_FAILED;
+            progress.step  = i;
+            progress.cmd   = steps[i].cmd;
+            return;
+        }
+    }
+
+    reloadRepeats(0, length);
+    progress.state = (length > 0) ? SEQ_RUNNING : SEQ_DONE;
+}
+
+void sequenceStop(void)
+{
+    if ( progress.state == SEQ_RUNNING ) progress.state = SEQ_STOPPED;
+}
+
+SequenceStepRecord* sequenceNext(unsigned long now)
+{
+    SequenceStepRecord *step;
+    SeqWaitArgs   wait;
+    SeqRepeatArgs repeat;
+
+    if ( progress.state != SEQ_RUNNING ) return NULL;
+
+    // Waits and repeats are gone through here, commands are handed out
+    while ( cursor < length )
+    {
+        step = &steps[cursor];
+
+        if ( step->cmd == SEQ_WAIT )
+        {
+            LAYOUT_UNPACK(wait, step->args, step->length);
+            if ( !is_waiting )
+            {
+                is_waiting = 1;
+                wait_start = now;
+            }
+            if ( (now - wait_start) / 1000 < wait.time ) return NULL;
+            is_waiting = 0;
+            cursor++;
+        } else if ( step->cmd == SEQ_REPEAT ) {
+            LAYOUT_UNPACK(repeat, step->args, step->length);
+            if ( remaining[cursor] > 0 )
+            {
+                remaining[cursor]--;
+                reloadRepeats(repeat.first, cursor);
+                cursor = repeat.first;
+            } else {
+                cursor++;
+            }
+        } else {
+            progress.step = cursor;
+            progress.cmd  = step->cmd;
+            progress.time = now;
+            progress.executed++;
+            cursor++;
+            return step;
+        }
+    }
+
+    progress.state = SEQ_DONE;
+    return NULL;
+}
+
+SequenceProgressRecord* sequenceGetProgress(void)
+{
+    return &progress;
+}
+
+// =========== Private Functions ==============================================
+
+static unsigned char checkStep(unsigned int index)
+{
+    SequenceStepRecord *step = &steps[index];
+    SeqWaitArgs   wait;
+    SeqRepeatArgs repeat;
+
+    if ( step->length > SEQ_ARGS_SIZE ) return 0;
+
+    switch ( step->cmd )
+    {
+        case SEQ_WAIT:
+            return LAYOUT_UNPACK(wait, step->args, step->length);
+
+        case SEQ_REPEAT:
+            // Only backwards, which keeps every sequence finite
+            if ( !LAYOUT_UNPACK(repeat, step->args, step->length) ) return 0;
+            return repeat.first <= index;
+
+        case CMD_RESET:
+        case CMD_SET_SEQUENCE:
+        case CMD_RUN_SEQUENCE:
+            return 0;
+
+        default:
+            return 1;
+    }
+}
+
+static void reloadRepeats(unsigned int first, unsigned int last)
+{
+    SeqRepeatArgs repeat;
+    unsigned int i;
+
+    // Repeats nested in a loop start over on each of its passes
+    for ( i = first; i < last; i++ )
+    {
+        if ( steps[i].cmd == SEQ_REPEAT )
+        {
+            LAYOUT_UNPACK(repeat, steps[i].args, steps[i].length);
+            remaining[i] = repeat.count;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * On-board experiment sequencer
+ */
+
+#ifndef __SEQUENCE_H
+#define __SEQUENCE_H
+
+
+#include "layout.h"
+
+
+void sequenceSetup(void);
+
+// Stops any running sequence and empties the table.
+void sequenceClear(void);
+
+// Sets a step of the table, which must be filled in order and not while the
+// sequence runs. Steps are commands, as sent over the radio, or SEQ_WAIT and
+// SEQ_REPEAT.
+void sequenceSetStep(unsigned int index, SequenceStepRecord *step);
+
+unsigned int sequenceGetLength(void);
+
+// Runs the table from its first step, at time now [us]. Tables that could
+// not be run as a whole (malformed steps, or commands that would reset the
+// board or the sequence) fail here, before any step is taken.
+void sequenceStart(unsigned long now);
+
+// Stops a running sequence, leaving the table as is.
+void sequenceStop(void);
+
+// Next command step due at time now [us], having gone through the waits and
+// repeats before it, or NULL if there is none for now: while waiting, or
+// once the sequence is no longer running.
+SequenceStepRecord* sequenceNext(unsigned long now);
+
+// State and last step of the sequence, as reported to the host.
+SequenceProgressRecord* sequenceGetProgress(void);
+
+
+#endif // __SEQUENCE_H
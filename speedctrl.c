@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Back-EMF speed controller
+ */
+
+#include "speedctrl.h"
+
+
+// =========== Static Variables ===============================================
+static unsigned int out_max;
+static unsigned int setpoint;
+static int kp, ki;
+
+static long integral;       // Q8.8 [duty cycle register value]
+static int error;
+static unsigned int output;
+
+// =========== Public Functions ===============================================
+
+void speedctrlSetup(unsigned int max)
+{
+    out_max  = max;
+    setpoint = 0;
+    kp       = 0;
+    ki       = 0;
+
+    speedctrlReset();
+}
+
+void speedctrlSetGains(int p, int i)
+{
+    kp = p;
+    ki = i;
+}
+
+void speedctrlSetSetpoint(unsigned int bemf)
+{
+    setpoint = bemf;
+}
+
+void speedctrlReset(void)
+{
+    integral = 0;
+    error    = 0;
+    output   = 0;
+}
+
+unsigned int speedctrlUpdate(unsigned int bemf)
+{
+    long integral_max = (long) out_max << SPEEDCTRL_GAIN_SHIFT,
+         u;
+
+    error = (int) setpoint - (int) bemf;
+
+    // Integrate, clamping the integrator to the output range (anti-windup)
+    integral += (long) ki * error;
+    if ( integral > integral_max )
+    {
+        integral = integral_max;
+    } else if ( integral < 0 ) {
+        integral = 0;
+    }
+
+    u = ((long) kp * error + integral) >> SPEEDCTRL_GAIN_SHIFT;
+    if ( u > (long) out_max )
+    {
+        u = out_max;
+    } else if ( u < 0 ) {
+        u = 0;
+    }
+
+    output = (unsigned int) u;
+    return output;
+}
+
+int speedctrlGetError(void)
+{
+    return error;
+}
+
+unsigned int speedctrlGetOutput(void)
+{
+    return output;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2013, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Back-EMF speed controller
+ */
+
+#ifndef __SPEEDCTRL_H
+#define __SPEEDCTRL_H
+
+
+// Back-EMF and setpoint in ADC counts, gains in Q8.8.
+#define SPEEDCTRL_GAIN_SHIFT    (8)
+
+
+void speedctrlSetup(unsigned int out_max);
+
+void speedctrlSetGains(int kp, int ki);
+
+void speedctrlSetSetpoint(unsigned int setpoint);
+
+// Clears the integrator, so that the next update starts from rest.
+void speedctrlReset(void);
+
+// Runs one controller step on a back-EMF sample, returning the duty cycle.
+unsigned int speedctrlUpdate(unsigned int bemf);
+
+// Last error [ADC counts] and output [duty cycle register value].
+int speedctrlGetError(void);
+
+unsigned int speedctrlGetOutput(void);
+
+
+#endif // __SPEEDCTRL_H